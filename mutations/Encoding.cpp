@@ -0,0 +1,126 @@
+//
+//  Encoding.cpp
+//
+
+#include "Encoding.h"
+
+#include <ctype.h>
+
+#define X INVALID_CODE
+const u_char nucleotide_code[256] = {
+    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+    X,0,X,1,X,X,X,2,X,X,X,X,X,X,X,X,    X,X,X,X,3,X,X,X,X,X,X,X,X,X,X,X,   //A C G T
+    X,0,X,1,X,X,X,2,X,X,X,X,X,X,X,X,    X,X,X,X,3,X,X,X,X,X,X,X,X,X,X,X,   //a c g t
+    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,    X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+};
+#undef X
+
+#pragma mark - Packed sequences
+/**
+ Key of every word of length WORDSIZE in +data+, -1 for words with an ambiguous
+ base. Shifts one base into the key per position instead of re-encoding the
+ whole word, 32 bases of +data+ read at a time, and counts the bases since the
+ last ambiguous one to know when the key is valid again.
+ */
+void encode_kmers(const PackedSequence &data, Chromosome &keys) {
+    const std::size_t size = data.size();
+    keys.resize(size >= WORDSIZE ? size-WORDSIZE+1 : 0);
+    
+    const u_int64_t mask = (static_cast<u_int64_t>(1) << (2*WORDSIZE)) - 1;
+    u_int64_t key = 0;
+    std::size_t run = 0;    //bases since the last ambiguous one
+    
+    for (std::size_t i = 0; i < size; i += 32) {
+        u_int64_t bases = data.bases(static_cast<long>(i));
+        u_int32_t ambiguous = data.ambiguous(static_cast<long>(i));
+        const std::size_t last = std::min<std::size_t>(size, i+32);
+        
+        for (std::size_t j = i; j < last; ++j, bases >>= 2, ambiguous >>= 1) {
+            run = (ambiguous & 1) ? 0 : run+1;
+            key = ((key << 2) | (bases & 0x03)) & mask;
+            
+            if (j+1 >= WORDSIZE)
+                keys[j+1-WORDSIZE] = run >= WORDSIZE ? static_cast<Hash>(key) : -1;
+        }
+    }
+}
+
+/**
+ Key of the word starting at every +stride+ position of +data+ (+forward+) and
+ of its reverse complement (+reverse+) in one pass: reverse anchor k is the
+ complement of the forward word ending k*stride bases before the end of +data+,
+ read backwards. Words with an ambiguous base or running past the end are -1.
+ */
+void encode_anchors(const PackedSequence &data, const std::size_t stride, Chromosome &forward, Chromosome &reverse) {
+    const std::size_t size = data.size();
+    const std::size_t n = (size + stride - 1) / stride;
+    forward.resize(n);
+    reverse.resize(n);
+    
+    for (std::size_t k = 0; k < n; ++k) {
+        const std::size_t i = k*stride;
+        forward[k] = encode_word(data, i);
+        
+        const Hash key = size-i >= WORDSIZE ? encode_word(data, size-i-WORDSIZE) : -1;
+        reverse[k] = key < 0 ? -1 : reverse_complement(key);
+    }
+}
+
+void mask_soft_masked(const Sequence &data, Chromosome &keys) {
+    std::size_t run = 0;    //bases since the last lowercase letter
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        run = islower(static_cast<u_char>(data[i])) ? 0 : run+1;
+        if (i+1 >= WORDSIZE && i+1-WORDSIZE < keys.size() && run < WORDSIZE)
+            keys[i+1-WORDSIZE] = -1;
+    }
+}
+
+void mask_soft_masked(const std::vector<MaskBlock> &soft_masked, Chromosome &keys) {
+    for (std::size_t b = 0; b < soft_masked.size(); ++b) {
+        const MaskBlock &block = soft_masked[b];
+        const std::size_t first = block.start+1 >= WORDSIZE ? block.start+1-WORDSIZE : 0;
+        const std::size_t last = std::min<std::size_t>(keys.size(), block.start + block.length);
+        for (std::size_t k = first; k < last; ++k)
+            keys[k] = -1;
+    }
+}
+
+void dust(const PackedSequence &data, const double threshold, std::vector<bool> &low) {
+    const std::size_t size = data.size();
+    low.assign(size, false);
+    
+    const std::size_t window = std::min<std::size_t>(DUST_WINDOW, size);
+    if (window < 4) return;
+    const std::size_t triplets = window-2;
+    
+    //code of the triplet at p with base p in the lowest bits, triplets with an
+    //ambiguous base are not counted (64)
+    const auto triplet = [&data](const std::size_t p) -> u_int32_t {
+        return (data.ambiguous(static_cast<long>(p)) & 0x07) ? 64 : static_cast<u_int32_t>(data.bases(static_cast<long>(p)) & 0x3F);
+    };
+    
+    //window [start, start+window) slides along
+    u_int32_t counts[65] = {0};
+    std::size_t sum = 0, start = 0;
+    const auto add = [&](const u_int32_t t) { if (t < 64) sum += counts[t]; ++counts[t]; };
+    const auto remove = [&](const u_int32_t t) { --counts[t]; if (t < 64) sum -= counts[t]; };
+    for (std::size_t p = 0; p < triplets; ++p)
+        add(triplet(p));
+    
+    for (std::size_t i = 0; i < size; ++i) {
+        //window centred on the word at i, kept inside the sequence
+        const std::size_t centre = i + WORDSIZE/2;
+        const std::size_t first = std::min(centre > window/2 ? centre - window/2 : 0, size-window);
+        for (; start < first; ++start) {
+            remove(triplet(start));
+            add(triplet(start + triplets));
+        }
+        
+        const std::size_t counted = triplets - counts[64];
+        low[i] = counted > 1 && static_cast<double>(sum) / (counted-1) > threshold;
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  Encoding.h
+//
+
+#ifndef Encoding_hpp
+#define Encoding_hpp
+
+#include <cstddef>
+#include <sys/types.h>
+
+#include "Types.h"
+#include "PackedSequence.h"
+#include "IO.h"
+
+#define INVALID_CODE 0x04
+
+/**
+ 2-bit code (BA_ENCODED_*) of every byte, INVALID_CODE for letters outside ACGT/acgt
+ */
+extern const u_char nucleotide_code[256];
+
+/**
+ Key of the reverse complement of the word encoded by +key+
+ */
+inline Hash reverse_complement(const Hash key) {
+    u_int64_t x = ~static_cast<u_int64_t>(key);     //complement, A(0)<->T(3) and C(1)<->G(2)
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = __builtin_bswap64(x);
+    return static_cast<Hash>(x >> (64 - 2*WORDSIZE));
+}
+
+/**
+ Key of the word at +pos+ of +data+, -1 if it holds an ambiguous base or runs
+ past the end. The first base is in the highest bits.
+ */
+inline Hash encode_word(const PackedSequence &data, const std::size_t pos) {
+    if (pos + WORDSIZE > data.size() || (data.ambiguous(static_cast<long>(pos)) & ((static_cast<u_int64_t>(1) << WORDSIZE) - 1)))
+        return -1;
+    return static_cast<Hash>(reverse_bases(data.bases(static_cast<long>(pos))) >> (64 - 2*WORDSIZE));
+}
+
+void encode_kmers(const PackedSequence &data, Chromosome &keys);
+
+#define DUST_WINDOW 64
+
+/**
+ Flags the words of +data+ that lie in low complexity sequence, low[i] for the
+ word at i. A word is flagged when the DUST_WINDOW bases centred on it score
+ above +threshold+ by symmetric DUST: the sum of c(c-1)/2 over the counts c of
+ the 64 triplets, divided by the number of triplets less one.
+ */
+void dust(const PackedSequence &data, const double threshold, std::vector<bool> &low);
+
+/**
+ Sets to -1 the keys of the words holding a soft-masked (lowercase) base of
+ +data+, given as its text or as its runs of lowercase bases
+ */
+void mask_soft_masked(const Sequence &data, Chromosome &keys);
+void mask_soft_masked(const std::vector<MaskBlock> &soft_masked, Chromosome &keys);
+void encode_anchors(const PackedSequence &data, const std::size_t stride, Chromosome &forward, Chromosome &reverse);
+
+#endif /* Encoding_hpp */
@@ -0,0 +1,85 @@
+//
+//  Extension.cpp
+//
+
+#include "Extension.h"
+
+#include <sys/types.h>
+
+/**
+ Progress of one extension, fed the positions where something happens in
+ increasing order (an ambiguous base or a mismatch) and tells when to stop
+ */
+struct Scan {
+    Scan() : count(0), first(0), stop(0) {}
+    
+    //true once the extension ends at +pos+
+    bool event(const std::size_t pos, const bool n) {
+        if (n || ++count == 2) {
+            stop = pos;
+            return true;
+        }
+        first = pos;
+        return false;
+    }
+    
+    int count;
+    std::size_t first, stop;
+};
+
+/**
+ How the two sequences are read, as by read_bases(). +LEFT+ extensions report a
+ first mismatch at position 0 as 1.
+ 
+ 32 bases are compared per step, XOR of the packed words folded to one bit per
+ base, and the positions of the mismatches and ambiguous bases visited in order
+ with ctz.
+ */
+template <bool A_BACKWARDS, bool B_BACKWARDS, bool A_COMPLEMENT, bool LEFT>
+class Extender {
+public:
+    static long extend(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos) {
+        Scan scan;
+        for (std::size_t k = 0; k < n; k += 32) {
+            u_int64_t mismatches, ambiguous;
+            compare_bases<A_BACKWARDS, B_BACKWARDS, A_COMPLEMENT>(a, pa, b, pb, k, mismatches, ambiguous);
+            
+            u_int64_t events = mismatches | ambiguous;
+            if (n-k < 32)
+                events &= (static_cast<u_int64_t>(1) << 2*(n-k)) - 1;
+            
+            for (; events; events &= events-1) {
+                const int bit = __builtin_ctzll(events);
+                if (scan.event(k + bit/2, (ambiguous >> bit) & 1))
+                    return finish(scan, true, n, mut_pos);
+            }
+        }
+        return finish(scan, false, n, mut_pos);
+    }
+    
+private:
+    static long finish(const Scan &scan, const bool stopped, const std::size_t n, int &mut_pos) {
+        const std::size_t length = stopped ? scan.stop : n;
+        if (scan.count == 0)
+            mut_pos = static_cast<int>(length);
+        else
+            mut_pos = (LEFT && scan.first == 0) ? 1 : static_cast<int>(scan.first);
+        return static_cast<long>(length);
+    }
+};
+
+long extend_forward(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos) {
+    return Extender<false, false, false, false>::extend(a, pa, b, pb, n, mut_pos);
+}
+
+long extend_reverse(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos) {
+    return Extender<true, true, false, true>::extend(a, pa, b, pb, n, mut_pos);
+}
+
+long extend_forward_rc(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos) {
+    return Extender<true, false, true, false>::extend(a, pa, b, pb, n, mut_pos);
+}
+
+long extend_reverse_rc(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos) {
+    return Extender<false, true, true, true>::extend(a, pa, b, pb, n, mut_pos);
+}
@@ -0,0 +1,31 @@
+//
+//  Extension.h
+//
+
+#ifndef Extension_hpp
+#define Extension_hpp
+
+#include <cstddef>
+
+#include "PackedSequence.h"
+
+/**
+ Length of the common extension of +a+ from +pa+ and +b+ from +pb+ (at most +n+
+ bases) allowing one mismatch. The extension stops at the second mismatch or at
+ the first ambiguous base in either sequence. +mut_pos+ is the position of the
+ first mismatch, or the length of the extension when there is none.
+ 
+ extend_forward() reads a[pa], a[pa+1], ... and extend_reverse() reads a[pa-1],
+ a[pa-2], ... in which case a first mismatch at position 0 is reported as 1.
+ */
+long extend_forward(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos);
+long extend_reverse(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos);
+
+/**
+ The same extensions with +a+ read through its reverse complement, the
+ complement of a[pa-1], a[pa-2], ... forward and of a[pa], a[pa+1], ... in reverse
+ */
+long extend_forward_rc(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos);
+long extend_reverse_rc(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n, int &mut_pos);
+
+#endif /* Extension_hpp */
@@ -0,0 +1,245 @@
+//
+//  LookupTable.h
+//
+
+#ifndef LookupTable_hpp
+#define LookupTable_hpp
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <sys/types.h>
+
+#include "Types.h"
+
+/**
+ Read-only view over the contiguous elements of one lookup table bucket
+ */
+class Bucket {
+public:
+    Bucket() : first(NULL), last(NULL) {}
+    Bucket(const Element *f, const Element *l) : first(f), last(l) {}
+
+    const Element * begin() const { return first; }
+    const Element * end() const { return last; }
+    std::size_t size() const { return static_cast<std::size_t>(last - first); }
+    bool empty() const { return first == last; }
+    const Element & operator[](const std::size_t i) const { return first[i]; }
+
+private:
+    const Element *first, *last;
+};
+
+/**
+ Anchor (begin, end) left out of a lookup table by cap(), with the number of
+ target positions it had
+ */
+struct CappedAnchor {
+    Hash begin, end;
+    u_int64_t count;
+};
+
+//words of more bits than this get a sparse table, 4^WORDSIZE buckets would not fit
+#ifndef LOOKUP_DIRECT_BITS
+#define LOOKUP_DIRECT_BITS 24
+#endif
+#define LOOKUP_SPARSE (2*WORDSIZE > LOOKUP_DIRECT_BITS)
+
+//leading bits of a word that index the directory of a sparse table
+#define LOOKUP_DIRECTORY_BITS (2*WORDSIZE < 20 ? 2*WORDSIZE : 20)
+
+//possible words, the buckets of a direct table
+#define LOOKUP_WORDS (static_cast<std::size_t>(1) << (2*WORDSIZE))
+
+//words a direct table lists as it counts them, past that many prepare() reads them off the headers
+#define LOOKUP_LISTED_WORDS (LOOKUP_WORDS/16)
+
+/**
+ Header of the bucket of one possible word in a direct table, only valid while
+ its generation is the table's
+ */
+struct BucketHeader {
+    BucketHeader() : generation(0), slot(0) {}
+    
+    u_int32_t generation;
+    u_int32_t slot;         //elements counted until prepare(), the next element inserted until seal(), then the bucket's place among the words present
+};
+
+/**
+ Compressed-sparse-row lookup table, one bucket per begin word of the target.
+
+ Built in two passes over the target: count() every key that will be inserted,
+ prepare() to turn the counts into bucket offsets, insert() the elements in the
+ same order they were counted and seal() to finish. Elements inside a bucket
+ keep their insertion order until sort() orders them by id, after which find()
+ returns the elements of a bucket with a given id.
+
+ Once sorted, cap() leaves out the anchors that occur too often in the target,
+ simple repeats that would otherwise give a candidate at each copy. capped()
+ tells how many positions such an anchor had.
+
+ Two bitmaps of the begin and end words present, 2 bits per possible word in
+ all, let may_contain() turn away most lookups of absent anchors from cache
+ instead of from the buckets.
+
+ A direct table keeps its storage from one build to the next. Only the words
+ present in the target get a bucket, found through a header per possible word
+ that carries the generation it was counted in; clear() starts a new generation
+ instead of zeroing the headers, and unsets only the presence bits it had set.
+ The elements only grow when a larger target comes along, so rebuilding for a
+ small target costs time in its own size rather than in 4^WORDSIZE.
+
+ Above LOOKUP_DIRECT_BITS the table is sparse: there are no headers, the words
+ of the buckets are kept sorted and a directory on the leading
+ LOOKUP_DIRECTORY_BITS of a word narrows the binary search for its bucket to a
+ few keys. The presence bitmaps hash the words into 8 bits per element.
+
+ A direct table over a large target can be built from several slices of it at
+ once: clear(slices) gives every slice its own histogram, and count() and
+ insert() of one slice can then run in parallel with those of the others, each
+ slice inserting its elements in order. prepare() turns the histograms into the
+ place of every slice inside each bucket, so a bucket holds the same elements in
+ the same order whatever the number of slices.
+
+ A table can also attach() to offsets and elements it does not own, e.g. the
+ read-only mapping of an index file written by a previous run.
+ */
+class LookupTable {
+public:
+    LookupTable();
+
+    void clear(const std::size_t slices = 1);
+    void release();
+
+    /**
+     Slices to build a table of +anchors+ from with --sliced-build: one per thread,
+     as long as their histograms take no more memory than the elements. Always 1
+     for a sparse table.
+     */
+    static std::size_t slices(const std::size_t anchors);
+    
+    /**
+     Bytes of the histograms of a table of +anchors+ while it is built, 0 unless sliced
+     */
+    static std::size_t slices_memory(const std::size_t anchors) {
+        const std::size_t n = slices(anchors);
+        return n > 1 ? n*LOOKUP_WORDS*sizeof(u_int32_t) : 0;
+    }
+
+    void count(const Hash key, const std::size_t slice = 0) {
+        if (LOOKUP_SPARSE)
+            keys_list.push_back(key);
+        else if (number_of_slices > 1)
+            ++histograms[slice*LOOKUP_WORDS + static_cast<std::size_t>(key)];
+        else {
+            BucketHeader &h = headers[key];
+            if (h.generation != generation) {
+                h.generation = generation;
+                h.slot = 0;
+                if (keys_list.size() < LOOKUP_LISTED_WORDS)
+                    keys_list.push_back(key);
+            }
+            ++h.slot;
+        }
+    }
+    void prepare();
+    void insert(const Hash key, const Element &e, const std::size_t slice = 0) {
+        if (number_of_slices > 1)
+            elements[histograms[slice*LOOKUP_WORDS + static_cast<std::size_t>(key)]++] = e;
+        else if (cursors)
+            elements[headers[key].slot++] = e;
+        else
+            elements[offsets[slot(key)]++] = e;
+    }
+    void seal();
+    void sort();
+    std::size_t cap(const std::size_t max_occurrences);
+
+    void attach(const std::size_t *offsets, const Hash *keys, const Element *elements, const std::size_t number_of_keys, const std::size_t size, const CappedAnchor *capped, const std::size_t number_of_capped, const u_int64_t *presence);
+
+    Bucket operator[](const Hash key) const {
+        const std::size_t k = slot(key);
+        if (k >= number_of_keys) return Bucket();
+        return Bucket(bucket_elements + bucket_offsets[k], bucket_elements + bucket_offsets[k+1]);
+    }
+
+    /**
+     False when the table holds no anchor (begin, end), capped ones included.
+     True does not mean that it does.
+     */
+    bool may_contain(const Hash begin, const Hash end) const {
+        const std::size_t b = presence_slot(begin), e = presence_slot(end);
+        return !presence_bits || (b < presence_slots && e < presence_slots && ((presence_bits[b >> 6] >> (b & 63)) & (presence_bits[(presence_slots + e) >> 6] >> ((presence_slots + e) & 63)) & 1));
+    }
+    
+    Bucket find(const Hash begin, const Hash end) const;
+    std::size_t capped(const Hash begin, const Hash end) const;
+
+    const std::size_t * offsets_data() const { return bucket_offsets; }
+    const Hash * keys_data() const { return bucket_keys; }
+    const Element * elements_data() const { return bucket_elements; }
+    std::size_t keys() const { return number_of_keys; }
+    std::size_t size() const { return number_of_elements; }
+    const CappedAnchor * capped_data() const { return capped_anchors; }
+    std::size_t capped_size() const { return number_of_capped; }
+    const u_int64_t * presence_data() const { return presence_bits; }
+    std::size_t presence_size() const { return presence_bits ? (2*presence_slots + 63)/64 : 0; }
+    static std::size_t presence_words(const std::size_t anchors);
+    void every_word_offsets(std::vector<std::size_t> &) const;
+
+private:
+    void prepare_slices();
+    void next_generation();
+    void forget();
+    void mark_present();
+    void index_keys();
+    
+    //bucket of +key+, number_of_keys if the table has none
+    std::size_t slot(const Hash key) const {
+        if (!LOOKUP_SPARSE) {
+            //a direct table attached without its words has a bucket per possible word
+            if (!bucket_keys) return static_cast<std::size_t>(key);
+            const BucketHeader &h = headers[key];
+            return h.generation == generation ? h.slot : number_of_keys;
+        }
+        
+        const std::size_t d = static_cast<std::size_t>(static_cast<u_int64_t>(key) >> (2*WORDSIZE - LOOKUP_DIRECTORY_BITS));
+        if (d+1 >= directory.size()) return number_of_keys;
+        const Hash *last = bucket_keys + directory[d+1];
+        const Hash *it = std::lower_bound(bucket_keys + directory[d], last, key);
+        return it != last && *it == key ? static_cast<std::size_t>(it - bucket_keys) : number_of_keys;
+    }
+    
+    //bit of +key+ in either presence bitmap
+    std::size_t presence_slot(const Hash key) const {
+        if (!LOOKUP_SPARSE) return static_cast<std::size_t>(key);
+        
+        u_int64_t x = static_cast<u_int64_t>(key);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return static_cast<std::size_t>(x ^ (x >> 31)) & (presence_slots-1);
+    }
+    
+    Hash key_at(const std::size_t k) const { return bucket_keys ? bucket_keys[k] : static_cast<Hash>(k); }
+    
+    std::vector<std::size_t> offsets;   //bucket k is [offsets[k], offsets[k+1])
+    std::vector<Hash> keys_list;        //word of bucket k, ascending (sparse: every key counted, direct: the first LOOKUP_LISTED_WORDS words present, until prepare())
+    std::vector<std::size_t> directory; //sparse: keys with leading bits d are [directory[d], directory[d+1])
+    std::vector<BucketHeader> headers;  //direct: bucket of every possible word
+    std::vector<u_int32_t> histograms;  //sliced: elements of word w counted by slice s at [s*LOOKUP_WORDS + w], then the slot it inserts at
+    Elements elements;
+    std::vector<CappedAnchor> capped_list;  //ordered by (begin, end)
+    std::vector<u_int64_t> presence;        //begin words in bits [0, slots), end words in [slots, 2*slots)
+    
+    //what the buckets are read from, either the vectors above or attached memory
+    const std::size_t *bucket_offsets;
+    const Hash *bucket_keys;
+    const Element *bucket_elements;
+    const CappedAnchor *capped_anchors;
+    const u_int64_t *presence_bits;
+    std::size_t number_of_keys, number_of_elements, number_of_capped, presence_slots, number_of_slices;
+    u_int32_t generation;       //of the headers counted since the last clear()
+    bool cursors;               //the headers hold the insert slots, elements fit in 32 bits
+};
+
+#endif /* LookupTable_hpp */
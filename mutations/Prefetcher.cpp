@@ -0,0 +1,101 @@
+//
+//  Prefetcher.cpp
+//
+
+#include "Prefetcher.h"
+
+#include <algorithm>
+
+#include "IO.h"
+#include "ThreadPool.h"
+#include "Timing.hpp"
+
+Prefetcher::Prefetcher() : stopping(false), loader(&Prefetcher::work, this) {}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    requested.notify_all();
+    loader.join();
+}
+
+void Prefetcher::request(const std::size_t ticket, const File &file, const bool soft_masked) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.count(ticket)) return;
+        
+        Entry &entry = entries[ticket];
+        entry.state = Entry::QUEUED;
+        entry.file = file;
+        entry.masked = soft_masked;
+        queue.push_back(ticket);
+    }
+    requested.notify_one();
+}
+
+void Prefetcher::take(const std::size_t ticket, const File &file, RecordTable &records, PackedSequence &sequence, double &waited, std::vector<MaskBlock> *soft_masked) {
+    scottgs::Timing wait;
+    wait.start();
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<std::size_t, Entry>::iterator it = entries.find(ticket);
+    
+    //not requested, or still waiting behind other files: cheaper to read it here
+    if (it == entries.end() || it->second.state == Entry::QUEUED) {
+        if (it != entries.end()) {
+            queue.erase(std::find(queue.begin(), queue.end(), ticket));
+            entries.erase(it);
+        }
+        lock.unlock();
+        
+        loadPackedContentsOFile(file, records, sequence, soft_masked);
+        waited = wait.getTotalElapsedTime();
+        return;
+    }
+    
+    //the loader may be inflating it with the pool, this thread runs the helpers meanwhile
+    lock.unlock();
+    thread_pool().help_until([this, &it]{
+        std::lock_guard<std::mutex> entries_lock(mutex);
+        return it->second.state == Entry::READY;
+    });
+    lock.lock();
+    sequence.swap(it->second.data);
+    records.swap(it->second.records);
+    if (soft_masked)
+        soft_masked->swap(it->second.soft_masked);
+    entries.erase(it);
+    
+    waited = wait.getTotalElapsedTime();
+}
+
+void Prefetcher::work() {
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mutex);
+        requested.wait(lock, [this]{ return stopping || !queue.empty(); });
+        if (stopping) return;
+        
+        const std::size_t ticket = queue.front();
+        queue.pop_front();
+        Entry &entry = entries[ticket];     //entries are only erased by take() once READY or while QUEUED
+        entry.state = Entry::LOADING;
+        const File file = entry.file;
+        const bool masked = entry.masked;
+        lock.unlock();
+        
+        RecordTable records;
+        PackedSequence data;
+        std::vector<MaskBlock> soft_masked;
+        loadPackedContentsOFile(file, records, data, masked ? &soft_masked : NULL);
+        
+        lock.lock();
+        entry.data.swap(data);
+        entry.records.swap(records);
+        entry.soft_masked.swap(soft_masked);
+        entry.state = Entry::READY;
+        lock.unlock();
+        thread_pool().wake();
+    }
+}
@@ -8,11 +8,9 @@
 
 #include "Serial.h"
 
-Limes limeObjs_target;
-Limes limeObjs_query;
-
 LookupTable vec2D;
 scottgs::Timing timer;
+SharedOutput lime_log(std::cout);   //log lines of the limes, a query range at a time
 
 #pragma mark - Utility functions
 /**
@@ -25,10 +23,10 @@ scottgs::Timing timer;
  variable. Be aware of endianess during conversion and use ntohl().
  @return returns a minimal, unique representation
  */
-u_int32_t encodeWord(const u_char* word, unsigned short len, bool &valid){
-	//assert(len<=sizeof(unsigned int)*4);
+u_int64_t encodeWord(const u_char* word, unsigned short len, bool &valid){
+	//assert(len<=sizeof(u_int64_t)*4);
     valid = true;
-	unsigned int buffer=0;
+	u_int64_t buffer=0;
 	unsigned short i;
 	for(i=0;i<len;i++){
 		switch(word[i]){
@@ -56,114 +54,140 @@ u_int32_t encodeWord(const u_char* word, unsigned short len, bool &valid){
 	return buffer;
 }
 
-void reverse_complement(Sequence &raw_data) {
-    std::reverse(raw_data.begin(), raw_data.end());
-    std::for_each(raw_data.begin(), raw_data.end(), [](char &c){
-        switch (c) {
-            case 'A':   case 'a':
-                c='T';
-                break;
-                
-            case 'C':   case 'c':
-                c='G';
-                break;
-                
-            case 'G':   case 'g':
-                c='C';
-                break;
-                
-            case 'T':   case 't':
-                c='A';
-                break;
-                
-            default:
-                break;
-        }
-    });
-}
-
 /**
- Linearized vector generation
+ Anchors of +data+ and of its reverse complement, without building the reverse complement
  */
-Chromosome generateVectorIndices(const Sequence &data) {
+void generateVectorIndecies(const PackedSequence &data, Chromosome &forward, Chromosome &reverse) {
     const int chunk = SEQLENGTH/2 - WORDSIZE/2;
-    std::size_t length = data.size();
-    Chromosome chromosome;
-    chromosome.reserve(length);
-    
-    bool valid;
-    for (size_t i = 0; i < length; i+=chunk) {
-        const std::string w = data.substr(i,WORDSIZE);
-        const u_int32_t hash = encodeWord((const u_char*)w.c_str(), WORDSIZE, valid);
-        chromosome.push_back(valid ? hash : -1);
-    }
-    return chromosome;
+    encode_anchors(data, chunk, forward, reverse);
 }
 
-void generateVectorIndecies(const Sequence &data, Chromosome &c) {
-    const int chunk = SEQLENGTH/2 - WORDSIZE/2;
-    size_t length = data.size();
-    
-    Chromosome chromosome;
-    chromosome.reserve(length);
-    
-    bool valid;
-    for (size_t i = 0; i < length; i+=chunk) {
-        const std::string w = data.substr(i,WORDSIZE);
-        const u_int32_t hash = encodeWord((const u_char*)w.c_str(), WORDSIZE, valid);
-        chromosome.push_back(valid ? hash : -1);
+/**
+    Lookup table generation
+ */
+/**
+ Sets to -1 the keys of the words flagged in +low+, forward[k] being the word at
+ k*stride and reverse[k] the reverse complement of the word that ends at
+ size - k*stride. Returns the number of keys masked.
+ */
+std::size_t mask_low_complexity(const std::vector<bool> &low, const std::size_t size, const std::size_t stride, Chromosome &forward, Chromosome *reverse) {
+    std::size_t masked = 0;
+    for (std::size_t k = 0; k < forward.size(); ++k) {
+        if (forward[k] >= 0 && low[k*stride]) {
+            forward[k] = -1;
+            ++masked;
+        }
     }
-    chromosome.swap(c);
+    for (std::size_t k = 0; reverse && k < reverse->size(); ++k) {
+        if ((*reverse)[k] >= 0 && low[size - k*stride - WORDSIZE]) {
+            (*reverse)[k] = -1;
+            ++masked;
+        }
+    }
+    return masked;
 }
 
 /**
-    Lookup table generation
+ Sets to -1 the keys of the words of +data+ that dust() flags, see above
  */
-Chromosome generateLookupTableIndices(const Sequence &data) {
-    size_t length = data.size()-WORDSIZE+1;
-    bool valid;
-    
+std::size_t mask_low_complexity(const PackedSequence &data, const std::size_t stride, Chromosome &forward, Chromosome *reverse) {
+    std::vector<bool> low;
+    dust(data, options.dust, low);
+    return mask_low_complexity(low, data.size(), stride, forward, reverse);
+}
+
+Chromosome generateLookupTableIndices(const PackedSequence &data) {
     Chromosome chromosome2;
-    chromosome2.resize(length);
-    for (size_t i = 0; i < length; ++i) {
-        const std::string w = data.substr(i,WORDSIZE);
-        const u_int32_t hash = encodeWord((const u_char*)w.c_str(), WORDSIZE, valid);
-        chromosome2[i] = valid ? hash : -1;
-    }
+    encode_kmers(data, chromosome2);
+    if (options.dust > 0)
+        mask_low_complexity(data, 1, chromosome2, NULL);
     return chromosome2;
 }
 
-void initializeLookupTable(const TargetChr &chr, std::string s="") {  //do we need second parameter (s)
-    vec2D.clear();
+/**
+ Keys of +data+ without the words that are soft-masked in +text+, the sequence
+ it was packed from, when --exclude-soft-masked is given
+ */
+Chromosome generateLookupTableIndices(const PackedSequence &data, const Sequence &text) {
+    Chromosome keys = generateLookupTableIndices(data);
+    if (options.exclude_soft_masked)
+        mask_soft_masked(text, keys);
+    return keys;
+}
+
+/**
+ Keys of +data+ without the words in its runs of lowercase bases +soft_masked+,
+ when --exclude-soft-masked is given
+ */
+Chromosome generateLookupTableIndices(const PackedSequence &data, const std::vector<MaskBlock> &soft_masked) {
+    Chromosome keys = generateLookupTableIndices(data);
+    if (options.exclude_soft_masked)
+        mask_soft_masked(soft_masked, keys);
+    return keys;
+}
+
+/**
+ Lookup table of the anchors of +chr+. With the +records+ of a target of several
+ sequences, anchors whose end word lies in a later record than their begin word
+ are left out, no match runs through the RECORD_SEPARATOR between them. Only
+ anchors whose begin word is in [first_key, last_key) are kept, one shard of a
+ table that would not fit in memory at once.
+ */
+void initializeLookupTable(LookupTable &table, const TargetChr &chr, const RecordTable &records, const u_int64_t first_key = 0, const u_int64_t last_key = ~static_cast<u_int64_t>(0)) {
+    const int chunk = SEQLENGTH/2 - WORDSIZE/2;
+    const size_t length = chr.size() > chunk ? chr.size()-chunk : 0;
+    if (length > ELEMENT_IDX_MASK) {
+        table.clear();
+        std::cerr << "error: target of " << chr.size() << " words does not fit in " << ELEMENT_IDX_BITS << " bit index positions" << std::endl;
+        return;
+    }
     
+    //slice s of the target is [s*slice_length, (s+1)*slice_length), counted and inserted by one thread
+    const std::size_t slices = LookupTable::slices(length);
+    const std::size_t slice_length = (length + slices - 1)/slices;
+    table.clear(slices);
+    ThreadPool &pool = thread_pool();
+
     //////////////////////////////
-    //Size of lookup table
+    //Size of each bucket
     //////////////////////////////
-    int size = static_cast<int>(pow(4, WORDSIZE));
+    pool.parallel_for(slices, [&](const std::size_t s){
+        const std::size_t first = s*slice_length, last = std::min(length, first + slice_length);
+        std::size_t next = records.find(first) + 1;     //record after the one holding i
+        for (std::size_t i = first; i < last; ++i) {
+            const Hash begin = chr[i];
+            const Hash end = chr[i+chunk];
+            
+            while (next < records.size() && records.start(next) <= i) ++next;
+            if (begin > -1 && end > -1 && static_cast<u_int64_t>(begin) >= first_key && static_cast<u_int64_t>(begin) < last_key && (next >= records.size() || i+chunk < records.start(next)))
+                table.count(begin, s);
+        }
+    });
+    table.prepare();
     
     //initialize lookuptable - holds location(s) of each possible word
-    vec2D.reserve(size);
-    for (int i = 0; i < size; ++i) {
-        Pos v;
-        v.reserve(4000);
-        vec2D.push_back(v);
-    }
-    
-    const int chunk = SEQLENGTH/2 - WORDSIZE/2;
-    const size_t length = chr.size()-chunk;
-    for (std::size_t i = 0; i < length; ++i) {
-        assert(i+chunk < chr.size());
-        const Hash begin = chr[i];
-        const Hash end = chr[i+chunk];
-    
-        if (begin > -1 && end > -1) {            // no negative values should be in Element.id
-            Pos & pos = vec2D[begin];
-            pos.push_back(Element(end, i));      //index (i) refers to the beginning
+    pool.parallel_for(slices, [&](const std::size_t s){
+        const std::size_t first = s*slice_length, last = std::min(length, first + slice_length);
+        std::size_t next = records.find(first) + 1;
+        for (std::size_t i = first; i < last; ++i) {
+            assert(i+chunk < chr.size());
+            const Hash begin = chr[i];
+            const Hash end = chr[i+chunk];
             
-            Pos & pos2 = vec2D[end];
-            pos2.push_back(Element(begin,i));
+            while (next < records.size() && records.start(next) <= i) ++next;
+            if (begin > -1 && end > -1 && static_cast<u_int64_t>(begin) >= first_key && static_cast<u_int64_t>(begin) < last_key && (next >= records.size() || i+chunk < records.start(next))) {            // no negative values should be in Element.id
+                table.insert(begin, Element(end, i), s);   //index (i) refers to the beginning
+            }
         }
-    }
+    });
+    table.seal();
+    
+    //buckets ordered by end word, (begin, end) anchors can be looked up directly
+    table.sort();
+    
+    //simple repeats would otherwise give a candidate at every copy
+    if (options.max_occurrences)
+        table.cap(options.max_occurrences);
 }
 
 //long offset(std::string::const_iterator first1, std::string::const_iterator last1, std::string::const_iterator first2, int &mut_pos) {
@@ -191,60 +215,6 @@ void initializeLookupTable(const TargetChr &chr, std::string s="") {  //do we ne
 //    //std::cout << "pos: " << pos << std::endl;
 //    return  std::distance(first1, pair.first);
 //}
-long offset(std::string::const_iterator first1, std::string::const_iterator last1, std::string::const_iterator first2, int &mut_pos) {
-    std::pair<std::string::const_iterator, std::string::const_iterator> pair;
-    
-    int count = 0, pos = 0, tmp = 0;
-    
-    pair = std::mismatch(first1, last1, first2, [&count,&pos,&tmp](char a, char b) {
-        if (a=='N' || b=='N') {
-            if(count==0) tmp=pos;
-            return false;
-        } else if (a!=b) {
-            count++;
-            if (count<2)
-                tmp=pos;
-        }
-        pos++;
-        return count<2;
-    });
-    
-    if(count==0)
-        tmp=pos;
-    
-    mut_pos=tmp;
-    
-    return  std::distance(first1, pair.first);
-}
-
-long offset(std::string::const_reverse_iterator first1, std::string::const_reverse_iterator last1, std::string::const_reverse_iterator first2, int &mut_pos) {
-    std::pair<std::string::const_reverse_iterator, std::string::const_reverse_iterator> pair;
-    
-    int count = 0, pos = 0, tmp = 0;
-    
-    pair = std::mismatch(first1, last1, first2, [&count,&pos,&tmp](char a, char b) {
-        if (a=='N' || b=='N') {
-            if(count==0) tmp=pos;
-            return false;
-        } else if (a!=b) {
-            count++;
-            if (count<2)
-                tmp = !pos ? 1 : pos;   //pos should always be pos
-        }
-        pos++;
-        return count<2;
-    });
-
-    if(count==0)
-        tmp=pos;
-//    else if(tmp==0)
-//        tmp=1;
-    
-    mut_pos = tmp;
-    
-    return  std::distance(first1, pair.first);
-}
-
 //long offset(std::string::const_reverse_iterator first1, std::string::const_reverse_iterator last1, std::string::const_reverse_iterator first2, int &mut_pos) {
 //    std::pair<std::string::const_reverse_iterator, std::string::const_reverse_iterator> pair;
 //    int count = 0;
@@ -330,19 +300,37 @@ void debug (const std::string direction, const long left_offset, const int left_
     }
 }
 
+/**
+ Orders +candidates+ by diagonal and along it by query position, so that the
+ anchors of one long match are extended one after the other
+ */
+void sort_by_diagonal(Candidates &candidates) {
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b){
+        return a.diagonal() < b.diagonal() || (a.diagonal() == b.diagonal() && a.idx_1 < b.idx_1);
+    });
+}
+
 /**
  Phase II - Fine grain filter
     d1 = query
     d2 = target
+ 
+ Candidates are visited by diagonal. An anchor inside the stretch that an earlier
+ anchor on the same diagonal matched up to its first mismatch meets the same
+ mismatches and gives the same lime (or none), so it is not extended again.
+ +cover+ carries the covered stretches over to the next batch.
  */
-void remove_invalid_lime_candidates(Candidates &candidates, const Query &d1, const Target &d2) {
+void remove_invalid_lime_candidates(Candidates &candidates, const PackedSequence &d1, const PackedSequence &d2, DiagonalCover &cover, LimeBuffer &limes) {
     if (candidates.empty()) return;
+    sort_by_diagonal(candidates);
     
     Candidates::size_type length = candidates.size();
-    const Sequence::size_type size1 = d1.length(), size2 = d2.length();
+    const std::size_t size1 = d1.size(), size2 = d2.size();
     
-    std::string::const_iterator d1_begin, d1_end=d1.end(), d2_begin, d2_end = d2.end();
-    std::string::const_reverse_iterator d1_rbegin, d1_rend=d1.rend(), d2_rbegin, d2_rend = d2.rend();
+    //query position up to which the current diagonal is covered
+    cover.start_batch(candidates);
+    long diagonal = candidates.front().diagonal();
+    std::size_t covered = cover.end(diagonal);
     
     int right_mut=0;
     int left_mut=0;
@@ -350,39 +338,36 @@ void remove_invalid_lime_candidates(Candidates &candidates, const Query &d1, con
         Candidate &c = candidates[i];
         const std::size_t idx_1 = c.idx_1;
         const std::size_t idx_2 = c.idx_2;
+        if (c.diagonal() != diagonal) {
+            diagonal = c.diagonal();
+            covered = cover.end(diagonal);
+        }
+        if (idx_1 < covered)
+            continue;
         
         //////////////////////////////////////////////////////////
         // scan in the forward direction (left to right)        //
         //////////////////////////////////////////////////////////
-        d1_begin = d1.begin();
-        d2_begin = d2.begin();
-        std::advance(d1_begin, idx_1);
-        std::advance(d2_begin, idx_2);
-
         const std::size_t queryDistanceToEnd = size1-idx_1;
         const std::size_t targetDistanceToEnd = size2-idx_2;
         
-//        if (idx_1==69359774) {
-//            //100144 100188
-//            std::cout << "found in forward: " << std::endl;
-//            std::cout << "idx  1: " << idx_1 << ", idx 2: " << idx_2 << std::endl;
-//        }
         right_mut=0;
-        const long right_offset = (queryDistanceToEnd < targetDistanceToEnd) ? offset(d1_begin, d1_end, d2_begin,right_mut) : offset(d2_begin,d2_end,d1_begin,right_mut);
-        //std::cout << "forward: right offset: " << right_offset << ", idx_1: " << idx_1 << ", idx_2: " << idx_2 << std::endl << std::endl;
+        const long right_offset = extend_forward(d1, idx_1, d2, idx_2, std::min(queryDistanceToEnd, targetDistanceToEnd), right_mut);
+        covered = idx_1 + std::max(right_mut, 1);
+        cover.set(diagonal, covered);
         if (right_offset < SEQLENGTH/2 - WORDSIZE/2)
             continue;
         
         //////////////////////////////////////////////////////////
         // scan in the forward direction (right to left)        //
         //////////////////////////////////////////////////////////
-        d1_rbegin = d1.rbegin();
-        d2_rbegin = d2.rbegin();
-        std::advance(d1_rbegin, size1-idx_1);
-        std::advance(d2_rbegin, size2-idx_2);
-
         left_mut=0;
-        const long left_offset = (idx_1 < idx_2) ? offset(d1_rbegin, d1_rend, d2_rbegin,left_mut) : offset(d2_rbegin, d2_rend, d1_rbegin,left_mut);
+        const long left_offset = extend_reverse(d1, idx_1, d2, idx_2, std::min(idx_1, idx_2), left_mut);
+        
+        //a mismatch right before the anchor is reported one base off, which
+        //later anchors do not share
+        if (left_mut == 1)
+            cover.set(diagonal, covered = idx_1 + 1);
         
         //left_offset left_mut right_mut right_offset
         const long diff = ((left_offset+right_mut) > (left_mut+right_offset)) ? left_offset+right_mut : left_mut+right_offset; //right_offset+left_offset;
@@ -390,13 +375,10 @@ void remove_invalid_lime_candidates(Candidates &candidates, const Query &d1, con
             const std::size_t target_start = (left_offset+right_mut > left_mut+right_offset) ? idx_2-left_offset : idx_2-left_mut;
             const std::size_t query_start = (left_offset+right_mut > left_mut+right_offset) ? idx_1-left_offset : idx_1-left_mut;
             
-            //limeObjs_target.push_back(std::make_pair(idx_2-left_offset,diff));
-            //limeObjs_query.push_back(std::make_pair(idx_1-left_offset,diff));
-            limeObjs_target.push_back(std::make_pair(target_start,diff));
-            limeObjs_query.push_back(std::make_pair(query_start,diff));
-
-            std::cout << "query_idx,target_idx,left_offset,left_mut,right_mut,right_offset,query_start,target_start,diff,query_seq,target_seq" << std::endl;
-            std::cout << idx_1 << "," << idx_2 << "," << left_offset << "," << left_mut << "," << right_mut << "," << right_offset << "," << query_start << "," << target_start << "," << diff << "," << d1.substr(query_start,diff) << "," << d2.substr(target_start,diff) << std::endl;
+            //limes.target.push_back(std::make_pair(idx_2-left_offset,diff));
+            //limes.query.push_back(std::make_pair(idx_1-left_offset,diff));
+            const LimeOrigin origin = {idx_1, idx_2, query_start, left_offset, right_offset, left_mut, right_mut, false};
+            limes.add(std::make_pair(target_start,diff), std::make_pair(query_start,diff), origin);
             ////////////////////////////////
             //use during debug only
             ////////////////////////////////
@@ -406,14 +388,29 @@ void remove_invalid_lime_candidates(Candidates &candidates, const Query &d1, con
     }
 }
 
-void remove_invalid_lime_candidates_reverse(Candidates &candidates, const Query &query_data, const Target &target_data) {
+/**
+ Reverse complement of query_data.substr(pos, length) where +pos+ is a position
+ on the reverse strand
+ */
+Sequence reverse_complement(const PackedSequence &query_data, const std::size_t pos, const std::size_t length) {
+    return query_data.reverse_complement(query_data.size()-pos-length, length);
+}
+
+/**
+ Phase II on the reverse strand, +idx_1+ of every candidate is a position on the
+ reverse complement of +query_data+, which is read backwards and complemented
+ instead of being built.
+ */
+void remove_invalid_lime_candidates_reverse(Candidates &candidates, const PackedSequence &query_data, const PackedSequence &target_data, DiagonalCover &cover, LimeBuffer &limes) {
     if (candidates.empty()) return;
+    sort_by_diagonal(candidates);
     
     Candidates::size_type length = candidates.size();
-    const Sequence::size_type size1 = query_data.length(), size2 = target_data.length();
+    const std::size_t size1 = query_data.size(), size2 = target_data.size();
     
-    std::string::const_iterator d1_begin, d1_end=query_data.end(), d2_begin, d2_end = target_data.end();
-    std::string::const_reverse_iterator d1_rbegin, d1_rend=query_data.rend(), d2_rbegin, d2_rend = target_data.rend();
+    cover.start_batch(candidates);
+    long diagonal = candidates.front().diagonal();
+    std::size_t covered = cover.end(diagonal);
     
     int right_mut=0;
     int left_mut=0;
@@ -422,27 +419,26 @@ void remove_invalid_lime_candidates_reverse(Candidates &candidates, const Query
         Candidate &c = candidates[i];
         const std::size_t idx_1 = c.idx_1;
         const std::size_t idx_2 = c.idx_2;
+        if (c.diagonal() != diagonal) {
+            diagonal = c.diagonal();
+            covered = cover.end(diagonal);
+        }
+        if (idx_1 < covered)
+            continue;
         
+        //reverse strand position idx_1 is the complement of query_data[size1-1-idx_1]
+        const std::size_t d1 = size1-idx_1;
 
         //////////////////////////////////////////////////////////
         // scan in the forward direction (left to right)        //
         //////////////////////////////////////////////////////////
-        d1_begin = query_data.begin();
-        d2_begin = target_data.begin();
-        std::advance(d1_begin, idx_1);
-        std::advance(d2_begin, idx_2);
-
         const std::size_t queryDistanceToEnd = size1-idx_1;
         const std::size_t targetDistanceToEnd = size2-idx_2;
         
-//        if (idx_1==69359817) {
-//            //100144 100188
-//            std::cout << "found in reverse: " << std::endl;
-//            std::cout << "idx  1: " << idx_1 << ", idx 2: " << idx_2 << std::endl;
-//        }
-        
         right_mut = 0;
-        const long right_offset = (queryDistanceToEnd < targetDistanceToEnd) ? offset(d1_begin, d1_end, d2_begin,right_mut) : offset(d2_begin, d2_end, d1_begin,right_mut);
+        const long right_offset = extend_forward_rc(query_data, d1, target_data, idx_2, std::min(queryDistanceToEnd, targetDistanceToEnd), right_mut);
+        covered = idx_1 + std::max(right_mut, 1);
+        cover.set(diagonal, covered);
         
         if (right_offset < SEQLENGTH/2 - WORDSIZE/2)
             continue;
@@ -450,13 +446,10 @@ void remove_invalid_lime_candidates_reverse(Candidates &candidates, const Query
         //////////////////////////////////////////////////////////
         // scan in the reverse direction (right to left)        //
         //////////////////////////////////////////////////////////
-        d1_rbegin = query_data.rbegin();
-        d2_rbegin = target_data.rbegin();
-        std::advance(d1_rbegin, size1-idx_1);
-        std::advance(d2_rbegin, size2-idx_2);
-
         left_mut=0;
-        const long left_offset = (idx_1 < idx_2) ? offset(d1_rbegin, d1_rend, d2_rbegin,left_mut) : offset(d2_rbegin, d2_rend, d1_rbegin,left_mut);
+        const long left_offset = extend_reverse_rc(query_data, d1, target_data, idx_2, std::min(idx_1, idx_2), left_mut);
+        if (left_mut == 1)
+            cover.set(diagonal, covered = idx_1 + 1);
         
         const long diff = ((left_offset+right_mut) > (left_mut+right_offset)) ? left_offset+right_mut : left_mut+right_offset; //const long diff = right_offset+left_offset;
         if (diff  >= SEQLENGTH) {
@@ -465,192 +458,232 @@ void remove_invalid_lime_candidates_reverse(Candidates &candidates, const Query
             const std::size_t offset = (left_offset+right_mut > left_mut+right_offset) ? right_mut : right_offset;
             
     
-            const Sequence::size_type query_data_size = query_data.size();
-            const Sequence::size_type query_start = query_data_size - (idx_1+offset);
-            // const Sequence::size_type query_data_size = query_data.size();
-            //const Sequence::size_type query_start = query_data_size - (idx_1+right_offset);
-            
-            limeObjs_target.push_back(std::make_pair(target_start, diff));
-            limeObjs_query.push_back(std::make_pair(query_start, diff));
+            const std::size_t query_data_size = query_data.size();
+            const std::size_t query_start = query_data_size - (idx_1+offset);
             
             const std::size_t query_start2 = (left_offset+right_mut > left_mut+right_offset) ? idx_1-left_offset : idx_1-left_mut;
-            std::cout << "query_idx,target_idx,left_offset,left_mut,right_mut,right_offset,query_start,target_start,diff,query_seq,target_seq" << std::endl;
-            std::cout << idx_1 << "," << idx_2 << "," << left_offset << "," << left_mut << "," << right_mut << "," << right_offset << "," << query_start2 << "," << target_start << "," << diff << "," << query_data.substr(query_start2,diff) << "," << target_data.substr(target_start,diff) << std::endl;
-            
-            ////////////////////////////////
-            //use during debug only
-            ////////////////////////////////
-//            if (target_start == 12234178) {
-//                std::cout << "Actual query seq start pos: " << query_start << ", length: " << diff << std::endl << std::endl;
-//            }
-//            const std::size_t rev_qstart_pos = (left_offset+right_mut > left_mut+right_offset) ? idx_1-left_offset : idx_1-left_mut;
-//            debug("reverse", left_offset, left_mut, right_mut, right_offset, rev_qstart_pos, target_start, idx_1, idx_2, diff, query_data, target_data);
+            const LimeOrigin origin = {idx_1, idx_2, query_start2, left_offset, right_offset, left_mut, right_mut, true};
+            limes.add(std::make_pair(target_start, diff), std::make_pair(query_start, diff), origin);
          }
     }
 }
 
 #pragma mark - Coarse grain filter
+/**
+ Target anchors (begin, end) as candidates for the query anchor at +index+, the
+ presence bitmaps are asked first. Returns the positions of the anchor if
+ --max-occurrences left it out.
+ */
+std::size_t add_candidates(const LookupTable &table, const Hash begin, const Hash end, const std::size_t index, Candidates &candidates, LimeBuffer &limes) {
+    if (!table.may_contain(begin, end)) {
+        ++limes.prefilter_skips;
+        return 0;
+    }
+    ++limes.prefilter_hits;
+    
+    const Bucket bucket = table.find(begin, end);
+    if (bucket.empty())
+        return table.capped(begin, end);
+    for (const Element *e = bucket.begin(); e != bucket.end(); ++e)
+        candidates.push_back(Candidate(index, e->idx()));
+    return 0;
+}
+
 /**
     Phase I - Coarse grain filter
+ 
+    A query anchor is the pair of words (begin, end) starting SEQLENGTH/2 - WORDSIZE/2
+    apart. Every target anchor that matches it with at most one substitution in
+    either word is a candidate. Instead of scanning buckets, the table is probed
+    for the (begin, end) key itself and for each of the 3*WORDSIZE single
+    substitution neighbours of the end word and of the begin word.
  */
-void find_candidates(const Hash seqA_begin, const Hash seqA_end, const std::size_t index, Candidates &candidates);
-void generate_lime_candidates(const std::size_t i, const Chromosome &query_chr, Candidates &candidates ) {
+void generate_lime_candidates(const LookupTable &table, const std::size_t i, const Chromosome &query_chr, Candidates &candidates, LimeBuffer &limes) {
     
     const Hash seqA_begin = query_chr[i];
     const Hash seqA_end = query_chr[i+1];
     if (seqA_begin < 0 || seqA_end < 0)
         return;
     
-    const Pos & vec2DPos = vec2D[seqA_begin];
     const int chunk = SEQLENGTH/2 - WORDSIZE/2;
-    const std::size_t length = vec2DPos.size();
+    const std::size_t index = i*chunk;
     
-    const std::bitset<WORDSIZE*2> endA(seqA_end);
+    //exact match
+    std::size_t skipped = add_candidates(table, seqA_begin, seqA_end, index, candidates, limes);
+    if (skipped)
+        ++limes.skipped_anchors;
     
-    /**if (i*chunk == 84743296) {
-        std::cout << "query begin hash: " << seqA_begin << std::endl;
-        std::cout << "query end hash: " << seqA_end << std::endl;
-    }
-    */
-    for (int j = 0; j < length; ++j) {
-        const Element & element = vec2DPos[j];
-        const Hash seqB_end = element.id;
-        std::bitset<WORDSIZE*2> endB(seqB_end);
-        
-        
-      /*  if (i*chunk == 84743296 && seqB_end == 84743340) {
-            std::cout << "target end hash: " << seqB_end << ", target end hash location: " << element.idx << std::endl;
+    //////////////////////////////////////////////////////////////////////////
+    // One character occupies two bits, flipping them to each of the other
+    // three values gives the words one substitution away
+    //////////////////////////////////////////////////////////////////////////
+    for (int k = 0; k < WORDSIZE*2; k+=2) {
+        for (Hash d = 1; d < 4; ++d) {
+            skipped += add_candidates(table, seqA_begin, seqA_end ^ (d << k), index, candidates, limes);
+            skipped += add_candidates(table, seqA_begin ^ (d << k), seqA_end, index, candidates, limes);
         }
-        */
-        
-//        if (std::abs(i*chunk-14756104) < 20 && seqA_begin == 2105376 && seqA_end == 2631720 && seqB_end == seqA_end) {
-//            std::cout << "pos: " << i*chunk << ", motif hash: " << seqA_begin << std::endl;
-//        }
+    }
+    limes.skipped_candidates += skipped;
+}
 
-         endB ^= endA;
-        
-        //////////////////////////////////////////////////////////////////////////
-        // One character occupies two bits, hence less than 3
-        // Increment by 2 to avoid comparing bits from different characters
-        //////////////////////////////////////////////////////////////////////////
-        if (endB.none()) {
-            candidates.push_back(Candidate(i*chunk, element.idx));
-            //if (i*chunk == 84743296)
-                //std::cout << "i: " << i << ", id: " << element.id << ", idx: " << element.idx << std::endl;
-        }
-        else if(endB.count() < 3) {
-            int count = 0;
-            for (int k = 0; k < WORDSIZE*2; k+=2) {
-                if (endB[k] || endB[k+1]) count++;
-            }
-            
-            if(count < 2)
-                candidates.push_back(Candidate(i*chunk, element.idx));
+/**
+ Phase I over the query anchors [first, last) feeding phase II as it goes: the
+ candidates are handed to +verify+ whenever CANDIDATE_BATCH of them are waiting,
+ so memory does not grow with their number. They are counted in +limes+.
+ */
+void stream_lime_candidates(const LookupTable &table, const Chromosome &query_chr, const std::size_t first, const std::size_t last, LimeBuffer &limes, const std::function<void(Candidates &)> &verify) {
+    Candidates candidates;
+    candidates.reserve(CANDIDATE_BATCH);
+    
+    for (std::size_t i = first; i < last; ++i) {
+        generate_lime_candidates(table, i, query_chr, candidates, limes);
+        if (candidates.size() >= CANDIDATE_BATCH || i+1 == last) {
+            limes.candidates += candidates.size();
+            verify(candidates);
+            candidates.clear();
         }
     }
-    
-    find_candidates(seqA_begin, seqA_end, i*chunk, candidates);
-}
-
-//0.
-//S1 = {1	"3	10"	15}
-//S2 = {5	"3	10"	7	"4	10"	23}
-
-//1. get subset using 10 as the index giving subset S={3,7,4,23}
-//2. ignore keys that are identical to 3 from S giving S={7,4,23}
-//3. do bitwise comparison between 3 and 7,4,23 and select those that are at most 2 bit different - in this case giving 4.
-//4. calculate index for 3
-//5. index for 4 should be idx.
-void find_candidates(const Hash seqA_begin, const Hash seqA_end, const std::size_t index, Candidates &candidates) {
-    //1,2
-    Pos vec2DPos = vec2D[seqA_end];
-    vec2DPos.erase(std::remove_if(vec2DPos.begin(), vec2DPos.end(), [seqA_begin](const Element &e){
-        return e.id == seqA_begin;
-    }), vec2DPos.end());
-    
-    const std::bitset<WORDSIZE*2> begin_A(seqA_begin);
-    for (int i = 0; i < vec2DPos.size(); ++i) {
-        const Element e = vec2DPos[i];
-        std::bitset<WORDSIZE*2> begin_B(e.id);
-        
-        //3.
-        begin_B ^= begin_A;
-        if(begin_B.count() < 3) {
-            int count = 0;
-            for (int k = 0; k < WORDSIZE*2; k+=2) {
-                if (begin_B[k] || begin_B[k+1]) count++;
-            }
-            
-            //4,5
-            if(count < 2)
-                candidates.push_back(Candidate(index, e.idx));
+}
+
+/**
+ The two csv log lines of a lime found from +origin+, +query_data+ being the query
+ that was searched
+ */
+void write_lime_log(std::ostream &out, const LimeOrigin &origin, const Lime &target, const PackedSequence &query_data, const PackedSequence &target_data) {
+    const long diff = target.second;
+    out << "query_idx,target_idx,left_offset,left_mut,right_mut,right_offset,query_start,target_start,diff,query_seq,target_seq" << "\n";
+    out << origin.query_idx << "," << origin.target_idx << "," << origin.left_offset << "," << origin.left_mut << "," << origin.right_mut << "," << origin.right_offset << "," << origin.query_start << "," << target.first << "," << diff << ",";
+    out << (origin.reverse ? reverse_complement(query_data, origin.query_start, diff) : query_data.substr(origin.query_start, diff)) << "," << target_data.substr(target.first, diff) << "\n";
+}
+
+/**
+ Moves the limes of one strand of a query range into +limes+, leaving out those
+ +merged+ already holds, and writes their log lines
+ */
+void merge_query_range(LimeBuffer &range, std::unordered_set<LimePair, LimePairHash> &merged, const PackedSequence &query_data, const PackedSequence &target_data, LimeBuffer &limes) {
+    std::ostringstream log;
+    for (Limes::size_type i = 0; i < range.target.size(); ++i) {
+        if (merged.insert(LimePair(range.query[i], range.target[i])).second) {
+            limes.target.push_back(range.target[i]);
+            limes.query.push_back(range.query[i]);
+            write_lime_log(log, range.origins[i], range.target[i], query_data, target_data);
         }
     }
+    lime_log.write(log.str());
     
+    Limes().swap(range.target);
+    Limes().swap(range.query);
+    std::vector<LimeOrigin>().swap(range.origins);
+    limes.candidates += range.candidates;
+    limes.skipped_anchors += range.skipped_anchors;
+    limes.skipped_candidates += range.skipped_candidates;
+    limes.prefilter_hits += range.prefilter_hits;
+    limes.prefilter_skips += range.prefilter_skips;
 }
 
-void find_lime_candidates(Chromosome &query_chr, Candidates &candidates) {
+/**
+ Splits the query anchors into QUERY_RANGES contiguous ranges that are searched
+ by the thread pool, each range with its own candidates and limes for either
+ strand. Ranges are merged back in query order, forward strand first.
+ 
+ Each range starts with an empty DiagonalCover, so anchors just past a range
+ boundary can find again a lime of the range before. A lime is kept, and its
+ log lines written, the first time it is merged for its strand only.
+ 
+ A range is merged by the thread that finishes the last range before it, so
+ only the limes of ranges waiting for an earlier one are held, and the log
+ lines of a range are written as soon as it is merged.
+ */
+void search_query_ranges(const std::size_t iterations, const PackedSequence &query_data, const PackedSequence &target_data, LimeBuffer &limes, const std::function<void(std::size_t, std::size_t, LimeBuffer &, LimeBuffer &)> &search) {
+    ThreadPool &pool = thread_pool();
     
-    const std::size_t iterations = query_chr.size()-1;
-    for (std::size_t i = 0; i < iterations; ++i) {
-        generate_lime_candidates(i, query_chr, candidates);
-    }
+    //several ranges per thread so that repeat-rich ranges even out
+    const std::size_t ranges = std::min<std::size_t>(iterations, QUERY_RANGES);
+    if (ranges == 0) return;
+    
+    //merge order: the forward strand of every range, then the reverse strand of every range
+    std::vector<LimeBuffer> forward(ranges), reverse(ranges);
+    std::vector<bool> searched(ranges, false);
+    std::unordered_set<LimePair, LimePairHash> merged[2];   //limes of each strand
+    std::size_t next = 0;
+    std::mutex mutex;
+    pool.parallel_for(ranges, [&](const std::size_t k){
+        search(iterations*k/ranges, iterations*(k+1)/ranges, forward[k], reverse[k]);
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        searched[k] = true;
+        for (; next < 2*ranges && searched[next % ranges]; ++next) {
+            if (next < ranges)
+                merge_query_range(forward[next], merged[0], query_data, target_data, limes);
+            else
+                merge_query_range(reverse[next - ranges], merged[1], query_data, target_data, limes);
+        }
+    });
 }
 
-void find_limes_in_forward_direction(Chromosome &query_chr, const Query &query_data, const Target &target_data, Candidates &candidates) {
-    //////////////////////////
-    // Find candidate limes //
-    //////////////////////////
-    find_lime_candidates(query_chr, candidates);
-    
-    //////////////////////////////////
-    // Remove invalid candidates    //
-    //////////////////////////////////
-    remove_invalid_lime_candidates(candidates, query_data, target_data);
+/**
+ Counts in +limes+ the valid anchors of +keys+, those with a word flagged in +low+
+ and the target anchors that match them exactly. word(k) is the position of the
+ word of keys[k] in the query.
+ */
+void count_dust_anchors(const LookupTable &table, const Chromosome &keys, const std::vector<bool> &low, const std::function<std::size_t(std::size_t)> &word, LimeBuffer &limes) {
+    for (std::size_t i = 0; i+1 < keys.size(); ++i) {
+        if (keys[i] < 0 || keys[i+1] < 0)
+            continue;
+        ++limes.anchors;
+        if (low[word(i)] || low[word(i+1)]) {
+            ++limes.dust_anchors;
+            limes.dust_candidates += table.find(keys[i], keys[i+1]).size();
+        }
+    }
 }
 
-void find_limes_in_reverse_direction(Chromosome &query_chr, const Query &query_data, const Target &target_data, Candidates &candidates) {
-    //////////////////////////
-    // first stage filter   //
-    //////////////////////////
-    find_lime_candidates(query_chr, candidates);
+/**
+ Leaves the low complexity anchors of +query_data+ out of the search, counting
+ in +limes+ the valid anchors of both strands, how many of them it masked and
+ the candidates these would have had without a substitution. The 72 neighbours
+ of each masked anchor are not looked up, so that count is a lower bound.
+ */
+void dust_query_anchors(const LookupTable &table, const PackedSequence &query_data, Chromosome &forward, Chromosome &reverse, LimeBuffer &limes) {
+    const std::size_t stride = SEQLENGTH/2 - WORDSIZE/2, size = query_data.size();
+    std::vector<bool> low;
+    dust(query_data, options.dust, low);
     
-    //////////////////////////
-    // second stage filter  //
-    //////////////////////////
-    remove_invalid_lime_candidates_reverse(candidates, query_data, target_data);
+    count_dust_anchors(table, forward, low, [&](const std::size_t k){ return k*stride; }, limes);
+    count_dust_anchors(table, reverse, low, [&](const std::size_t k){ return size - k*stride - WORDSIZE; }, limes);
+    mask_low_complexity(low, size, stride, forward, &reverse);
 }
 
-
 /**
  target    = does not change
- query     = we scan it in the forward direction, then in the reverse direction
- a         = generated by target?
+ query     = searched on both strands at once, the reverse strand through the
+             reverse complement anchors and a reverse complement view of the query
 */
-void find_limes(const Target &target_data, const Query &query_data, const Chromosome& target_chr) {
+void find_limes(const LookupTable &table, const PackedSequence &target_data, const PackedSequence &query_data, LimeBuffer &limes) {
     //skips every chunk size (SEQLENGTH/2 - WORDSIZE/2)
-    Sequence query_data_cloned (query_data);
-    Chromosome query_chr = generateVectorIndices(query_data_cloned);
-    
-    Candidates candidates;
-    candidates.reserve(6000000);
-    
-    //////////////////////////
-    // forward scan         //
-    //////////////////////////
-    find_limes_in_forward_direction(query_chr, query_data_cloned, target_data, candidates);
-    candidates.clear();
-
-    //////////////////////////
-    // reverse-complement   //
-    //////////////////////////
-    reverse_complement(query_data_cloned);
+    Chromosome query_chr, query_rc_chr;
+    generateVectorIndecies(query_data, query_chr, query_rc_chr);
+    if (options.dust > 0)
+        dust_query_anchors(table, query_data, query_chr, query_rc_chr, limes);
     
-    //////////////////////////
-    // reverse scan         //
-    //////////////////////////
-    generateVectorIndecies(query_data_cloned, query_chr);
-    find_limes_in_reverse_direction(query_chr, query_data_cloned, target_data, candidates);
+    const std::size_t iterations = query_chr.empty() ? 0 : query_chr.size()-1;
+    search_query_ranges(iterations, query_data, target_data, limes, [&](const std::size_t first, const std::size_t last, LimeBuffer &forward, LimeBuffer &reverse){
+        //////////////////////////
+        // forward scan         //
+        //////////////////////////
+        DiagonalCover forward_cover;
+        stream_lime_candidates(table, query_chr, first, last, forward, [&](Candidates &candidates){
+            remove_invalid_lime_candidates(candidates, query_data, target_data, forward_cover, forward);
+        });
+        
+        //////////////////////////
+        // reverse scan         //
+        //////////////////////////
+        DiagonalCover reverse_cover;
+        stream_lime_candidates(table, query_rc_chr, first, last, reverse, [&](Candidates &candidates){
+            remove_invalid_lime_candidates_reverse(candidates, query_data, target_data, reverse_cover, reverse);
+        });
+    });
 }
 
 bool optimize(const std::vector<std::string> &g1, const std::vector<std::string> &g2) {
@@ -664,7 +697,309 @@ bool optimize(const std::vector<std::string> &g1, const std::vector<std::string>
     return g1Votes < g2Votes;
 }
 
+/**
+ Limes of a query of several records, each record searched on its own so that
+ its anchors are sampled from its own start and end, as when it is alone in a
+ file. Query positions are shifted back into +query_data+.
+ */
+void find_limes(const LookupTable &table, const PackedSequence &target_data, const PackedSequence &query_data, const RecordTable &query_records, LimeBuffer &limes) {
+    if (query_records.size() <= 1) {
+        find_limes(table, target_data, query_data, limes);
+        return;
+    }
+    
+    for (std::size_t r = 0; r < query_records.size(); ++r) {
+        const std::size_t start = query_records.start(r);
+        const std::size_t end = r+1 < query_records.size() ? query_records.start(r+1)-1 : query_data.size();
+        const PackedSequence record(query_data, start, end-start);
+        
+        const std::size_t first = limes.query.size();
+        find_limes(table, target_data, record, limes);
+        for (std::size_t i = first; i < limes.query.size(); ++i)
+            limes.query[i].first += start;
+    }
+}
+
+/**
+ Loads a target and fills the lookup table, either from a fasta file or by
+ mapping an index file written by `Limes index`. An index file must stay open
+ while the target is in use.
+ */
+bool load_target(const File &file, PackedSequence &target_data, RecordTable &records, LookupTable &table, IndexFile &index) {
+    if (has_extension(file, INDEX_FILE_EXTENSION))
+        return index.open(file) && index.load(records, target_data, table);
+    
+    index.close();
+    std::vector<MaskBlock> soft_masked;
+    loadPackedContentsOFile(file, records, target_data, options.exclude_soft_masked ? &soft_masked : NULL);
+    initializeLookupTable(table, generateLookupTableIndices(target_data, soft_masked), records);
+    return true;
+}
+
+/**
+ A target shared by every worker comparing a query with it, loaded ahead by the
+ builder thread and released by the last worker
+ */
+class TargetSlot {
+public:
+    TargetSlot() : state(EMPTY), remaining(0), memory(0), table(NULL) {}
+    
+    enum State { EMPTY, LOADING, READY } state;
+    std::size_t remaining;      //pairs that have not finished with it
+    std::size_t memory;         //reserved from the memory budget while loaded
+    
+    RecordTable records;
+    PackedSequence data;
+    LookupTable *table;     //one of the tables the builder alternates between
+    IndexFile index;
+};
+
+/**
+ Rough bytes held while a target is loaded: the sequence, its keys and the
+ slice histograms while the table is built, and the table itself
+ */
+std::size_t target_memory(const File &file) {
+    const std::size_t size = sequence_size(file);
+    const std::size_t buckets = LOOKUP_SPARSE ? size*(sizeof(Hash) + sizeof(std::size_t)) + ((static_cast<std::size_t>(1) << LOOKUP_DIRECTORY_BITS) + 1)*sizeof(std::size_t) : ((static_cast<std::size_t>(1) << (2*WORDSIZE)) + 1)*sizeof(std::size_t);
+    return size*(sizeof(char) + sizeof(Hash) + LOOKUP_ENTRIES_PER_ANCHOR*sizeof(Element)) + buckets + LookupTable::slices_memory(size);
+}
+
+/**
+ Rough bytes held while a query is searched, the sequence plus candidates and limes
+ */
+std::size_t query_memory(const File &file) {
+    return 2*sequence_size(file);
+}
+
+/**
+ Limes of one query record and one target record, sorted and without repeats,
+ as a search of those two sequences alone writes them. Scaffold blocks title
+ the target starts +target_title+ as they always have.
+ */
+void format_record_pair(std::ostringstream &out, const Header &query_header, Limes &query, const Header &target_header, Limes &target, const char *target_title = "#start_2") {
+    std::sort(query.begin(), query.end());
+    std::sort(target.begin(), target.end());
+    const Limes::iterator  q_it = std::unique(query.begin(), query.end());
+    const Limes::iterator  t_it = std::unique(target.begin(), target.end());
+    
+    out << "#1" << query_header << "\n";
+    out << "#start_1" << "\t" << "length" << "\n";
+    for (Limes::const_iterator l = query.begin(); l != q_it; ++l)
+        out << l->first << "\t" << l->second << "\n";
+    out << "#2" << target_header << "\n";
+    out << target_title << "\t" << "length" << "\n";
+    for (Limes::const_iterator l = target.begin(); l != t_it; ++l)
+        out << l->first << "\t" << l->second << "\n";
+}
+
+/**
+ Limes of one pair in the format of the limes file, nothing when there are none.
+ Files of several records get a block per (query record, target record) pair
+ with limes, in record order, positions within the records.
+ */
+std::string format_limes(LimeBuffer &limeObjs, const RecordTable &query_records, const RecordTable &target_records) {
+    assert(limeObjs.target.size() == limeObjs.query.size());
+    
+    //(query record, target record) of every lime, a lime never spans two records
+    std::vector<std::pair<std::pair<std::size_t, std::size_t>, std::size_t> > order;
+    order.reserve(limeObjs.target.size());
+    for (std::size_t i = 0; i < limeObjs.target.size(); ++i)
+        order.push_back(std::make_pair(std::make_pair(query_records.find(limeObjs.query[i].first), target_records.find(limeObjs.target[i].first)), i));
+    std::sort(order.begin(), order.end());
+    
+    std::ostringstream out;
+    for (std::size_t first = 0, last = 0; first < order.size(); first = last) {
+        const std::size_t q = order[first].first.first, t = order[first].first.second;
+        Limes query, target;
+        for (last = first; last < order.size() && order[last].first == order[first].first; ++last) {
+            const std::size_t i = order[last].second;
+            query.push_back(std::make_pair(limeObjs.query[i].first - query_records.start(q), limeObjs.query[i].second));
+            target.push_back(std::make_pair(limeObjs.target[i].first - target_records.start(t), limeObjs.target[i].second));
+        }
+        format_record_pair(out, query_records.header(q), query, target_records.header(t), target);
+    }
+    return out.str();
+}
+
+/**
+ Limes of one query against a block of scaffolds, appended to the text of the
+ scaffold each was found in with target positions within that scaffold. The
+ text of a scaffold is what a search of the query against it alone writes.
+ */
+void format_scaffold_limes(LimeBuffer &limeObjs, const Header &query_header, const RecordTable &records, std::vector<std::string> &scaffolds) {
+    assert(limeObjs.target.size() == limeObjs.query.size());
+    
+    //(scaffold, lime) for every lime, a lime never spans two scaffolds
+    std::vector<std::pair<std::size_t, std::size_t> > order;
+    order.reserve(limeObjs.target.size());
+    for (std::size_t i = 0; i < limeObjs.target.size(); ++i)
+        order.push_back(std::make_pair(records.find(limeObjs.target[i].first), i));
+    std::sort(order.begin(), order.end());
+    
+    for (std::size_t first = 0, last = 0; first < order.size(); first = last) {
+        const std::size_t r = order[first].first;
+        Limes query, target;
+        for (last = first; last < order.size() && order[last].first == r; ++last) {
+            const std::size_t i = order[last].second;
+            query.push_back(limeObjs.query[i]);
+            target.push_back(std::make_pair(limeObjs.target[i].first - records.start(r), limeObjs.target[i].second));
+        }
+        std::ostringstream out;
+        format_record_pair(out, query_header, query, records.header(r), target, "start_2");
+        scaffolds[r] += out.str();
+    }
+    limeObjs.target.clear();
+    limeObjs.query.clear();
+}
+
+#pragma mark - Whole-genome target
+/**
+ Limes of +limes+ whose target lies in [first, last) of the genome, moved to +part+
+ with target positions from +first+
+ */
+void select_limes(const LimeBuffer &limes, const std::size_t first, const std::size_t last, LimeBuffer &part) {
+    for (std::size_t i = 0; i < limes.target.size(); ++i) {
+        if (limes.target[i].first < first || limes.target[i].first >= last) continue;
+        part.target.push_back(std::make_pair(limes.target[i].first - first, limes.target[i].second));
+        part.query.push_back(limes.query[i]);
+    }
+}
+
+/**
+ +g1+ x +g2+ with every target file in one lookup table, so that each query file
+ is read, hashed and reverse complemented once instead of once per target. When
+ the table would not fit in options.memory it is built one shard of the begin
+ word range at a time and every query is searched once per shard. Limes are
+ written as the pairs would write them. Returns false, having written nothing,
+ if the targets cannot be searched this way.
+ */
+bool run_whole_genome(const Files &g1, const Files &g2, std::ofstream &out, std::ofstream &progress) {
+    for (Files::size_type i = 0; i < g1.size(); ++i) {
+        if (has_extension(g1[i], INDEX_FILE_EXTENSION)) {
+            info("--whole-genome reads the targets from fasta, %s is an index file\n", g1[i].c_str());
+            return false;
+        }
+    }
+    
+    //every target file packed into one sequence, the records of file i are [files[i], files[i+1])
+    timer.split();
+    PackedSequence data;
+    RecordTable records;
+    std::vector<MaskBlock> soft_masked;
+    std::vector<std::size_t> files(1, 0);
+    for (Files::size_type i = 0; i < g1.size(); ++i) {
+        RecordTable file_records;
+        PackedSequence sequence;
+        std::vector<MaskBlock> file_masked;
+        loadPackedContentsOFile(g1[i], file_records, sequence, options.exclude_soft_masked ? &file_masked : NULL);
+        if (i > 0)
+            data.append_ambiguous(1);   //RECORD_SEPARATOR
+        for (std::size_t r = 0; r < file_records.size(); ++r)
+            records.add(file_records.header(r), data.size() + file_records.start(r));
+        for (std::size_t m = 0; m < file_masked.size(); ++m) {
+            const MaskBlock mask = {data.size() + file_masked[m].start, file_masked[m].length};
+            soft_masked.push_back(mask);
+        }
+        data.append(sequence);
+        files.push_back(records.size());
+    }
+    
+    //the records of every file on their own, for output
+    std::vector<RecordTable> file_records(g1.size());
+    std::vector<std::size_t> file_start(g1.size()+1, data.size()+1);
+    for (Files::size_type i = g1.size(); i-- > 0; ) {
+        file_start[i] = files[i] < files[i+1] ? records.start(files[i]) : file_start[i+1];
+        for (std::size_t r = files[i]; r < files[i+1]; ++r)
+            file_records[i].add(records.header(r), records.start(r) - file_start[i]);
+    }
+    
+    //shards of the begin word range, as few as fit in what the packed sequence and the
+    //buckets leave. The keys of the whole genome are generated again for every shard, as
+    //the end word of an anchor may fall outside it, and are freed before its search.
+    //Every shard searches each query again, so there are at most 64.
+    const std::size_t buckets = LOOKUP_SPARSE ? 0 : ((static_cast<std::size_t>(1) << (2*WORDSIZE)) + 1)*sizeof(std::size_t);
+    const std::size_t held = data.size()/4 + data.size()/8 + soft_masked.size()*sizeof(MaskBlock) + buckets + LookupTable::slices_memory(data.size());
+    const std::size_t keys_size = data.size()*sizeof(Hash);
+    if (options.memory <= held + keys_size) {
+        info("--whole-genome needs %lu MB for the packed targets, their keys, the buckets and the slice histograms, more than --memory, searching the pairs instead\n", (held + keys_size) >> 20);
+        return false;
+    }
+    const std::size_t available = options.memory - held - keys_size;
+    const std::size_t table_size = data.size()*LOOKUP_ENTRIES_PER_ANCHOR*sizeof(Element);
+    const std::size_t shards = std::min<std::size_t>(64, std::max<std::size_t>(1, (table_size + available - 1)/available));
+    if (shards*available < table_size)
+        info("--whole-genome: the lookup table needs more than 64 shards of what --memory leaves, each shard will exceed it\n");
+    const u_int64_t words = static_cast<u_int64_t>(1) << (2*WORDSIZE);
+    const u_int64_t step = (words + shards - 1)/shards;
+    progress << "Whole genome = " << g1.size() << " files, " << records.size() << " records, " << data.size() << " bases in " << shards << " shard(s)" << "\n";
+    progress << "Loading time = " << timer.getSplitElapsedTime() << "\n" << std::endl;
+    
+    SharedOutput limes_output(out);
+    Prefetcher prefetcher;  //ticket: shard*queries + query
+    std::vector<LimeBuffer> found(g2.size());
+    for (std::size_t s = 0; s < shards; ++s) {
+        const u_int64_t first_key = s*step, last_key = std::min(words, first_key + step);
+        initializeLookupTable(vec2D, generateLookupTableIndices(data, soft_masked), records, first_key, last_key);
+        progress << "Shard " << s+1 << "/" << shards << "\t" << vec2D.size() << " target anchors" << "\n";
+        progress << "Indexing time = " << timer.getSplitElapsedTime() << "\n" << std::endl;
+        
+        for (Files::size_type j = 0; j < g2.size(); ++j) {
+            const std::size_t ticket = s*g2.size() + j;
+            if (j+1 < g2.size())
+                prefetcher.request(ticket+1, g2[j+1]);
+            else if (s+1 < shards)
+                prefetcher.request(ticket+1, g2.front());
+            
+            double query_wait = 0;
+            RecordTable query_records;
+            PackedSequence query_data;
+            prefetcher.take(ticket, g2[j], query_records, query_data, query_wait);
+            
+            LimeBuffer limeObjs;
+            find_limes(vec2D, data, query_data, query_records, limeObjs);
+            found[j].target.insert(found[j].target.end(), limeObjs.target.begin(), limeObjs.target.end());
+            found[j].query.insert(found[j].query.end(), limeObjs.query.begin(), limeObjs.query.end());
+            
+            //////////////////////////////////////
+            // Write limes to file, once per pair
+            //////////////////////////////////////
+            if (s+1 == shards) {
+                for (Files::size_type i = 0; i < g1.size(); ++i) {
+                    LimeBuffer part;
+                    select_limes(found[j], file_start[i], file_start[i+1], part);
+                    limes_output.write(format_limes(part, query_records, file_records[i]));
+                }
+                Limes().swap(found[j].target);
+                Limes().swap(found[j].query);
+            }
+            
+            progress << "Processing..." << j+1 << "/" << g2.size() << " (shard " << s+1 << ")" << "\n";
+            progress << g2[j] << "\n";
+            progress << "Waiting for I/O = " << query_wait << "\n";
+            progress << "Candidates = " << limeObjs.candidates << " (lookups " << limeObjs.prefilter_hits << ", skipped by prefilter " << limeObjs.prefilter_skips << ")" << "\n";
+            if (options.dust > 0)
+                progress << "Low complexity = " << (limeObjs.anchors ? 100.0*limeObjs.dust_anchors/limeObjs.anchors : 0) << "% of query anchors, at least " << limeObjs.dust_candidates << " candidates avoided" << "\n";
+            if (vec2D.capped_size())
+                progress << "Skipped repeats = " << limeObjs.skipped_anchors << " anchors, " << limeObjs.skipped_candidates << " candidates (" << vec2D.capped_size() << " target anchors capped)" << "\n";
+            progress << "Processing time = " << timer.getSplitElapsedTime() << "\n" << std::endl;
+        }
+    }
+    vec2D.release();
+    return true;
+}
+
 #pragma mark - Start of algorithm
+/**
+ Compares every file of +g1+ (targets) with every file of +g2+ (queries). The
+ pairs are shared by the worker threads, largest first, while the targets and
+ queries they hold fit in options.memory. Each target is loaded once and its
+ lookup table shared by all the pairs using it. Limes and progress are written
+ as the pairs finish, the limes of a pair in one block headed by its records,
+ so no pair's output waits for the pairs before it in file order.
+ 
+ While a pair is searched, the query of the next pair (and the next target when
+ the pair is the last one of its target) is read in the background.
+ */
 void run(const Files &g1, const Files &g2, const Output &pathToLimes, const Progress &pathToProgress) {
     std::cout << "Length search key: " << WORDSIZE << std::endl;
     
@@ -678,70 +1013,176 @@ void run(const Files &g1, const Files &g2, const Output &pathToLimes, const Prog
     const Files::size_type g1Size = genome1.size();
     const Files::size_type g2Size = genome2.size();
     
-    limeObjs_target.reserve(100000);
-    limeObjs_query.reserve(1000000);
-    Chromosome target_chr, query_chr;
-    Sequence target_data, query_data;
+    std::vector<std::size_t> target_sizes(g1Size), query_sizes(g2Size);
+    for (Files::size_type i = 0; i < g1Size; ++i) target_sizes[i] = sequence_size(genome1[i]);
+    for (Files::size_type j = 0; j < g2Size; ++j) query_sizes[j] = sequence_size(genome2[j]);
+    const std::vector<Pair> pairs = schedule_pairs(target_sizes, query_sizes);
     
-    Header targetSeqHeader, querySeqHeader;
+    std::vector<TargetSlot> targets(g1Size);
+    for (Files::size_type i = 0; i < g1Size; ++i) {
+        targets[i].remaining = g2Size;
+        targets[i].memory = target_memory(genome1[i]);
+    }
     
     std::ofstream out (pathToLimes.c_str());
     std::ofstream progress (pathToProgress.c_str());
+    if (options.whole_genome && run_whole_genome(genome1, genome2, out, progress)) {
+        progress << "Total time = " << timer.getTotalElapsedTime() << std::endl;
+        out.close();
+        progress.close();
+        timer.stop();
+        return;
+    }
     
+    SharedOutput limes_output(out);
+    MemoryBudget budget(options.memory);
+    Prefetcher prefetcher;  //tickets: pair k, then pairs.size() + target i
+    
+    std::mutex mutex;   //target slots and the progress file
+    std::condition_variable finished;
+    std::atomic<std::size_t> next(0);
     int counter = 1;
     
-    //note: outter loop should be the larger raw data size
-    for (Files::size_type i = 0; i < g1Size; ++i) {
-        const File targetSeqFile(genome1[i]);
-        
-        //////////////////////////////////////////////
-        // Skips by 1 letter
-        // goal: Need to minimize vec2D generation
-        //////////////////////////////////////////////
-        //timer.split();
-        target_data = loadDataWithContentsOFile(targetSeqFile, targetSeqHeader);
-        target_chr = generateLookupTableIndices(target_data);
-        initializeLookupTable(target_chr);
-        //std::cout << "Load and lookup table generation time: " << timer.getSplitElapsedTime() << std::endl;
-        
-        for (Files::size_type j = 0; j < g2Size; ++j) {
-            const File querySeqFile(genome2[j]);
+    //targets in the order their pairs run
+    std::vector<std::size_t> target_order;
+    for (const Pair &pair : pairs)
+        if (target_order.empty() || target_order.back() != pair.target)
+            target_order.push_back(pair.target);
+    
+    //////////////////////////////////////////////
+    // Double-buffered targets: the builder loads and indexes the next target
+    // while the workers search the current one, and only starts on the one
+    // after once the target before it has been released. Target n is built in
+    // tables[n % 2], which keeps its storage for target n+2, so the budget
+    // holds the largest target each table has had until the end of the run.
+    //////////////////////////////////////////////
+    ThreadPool &pool = thread_pool();
+    LookupTable tables[2];
+    std::size_t held[2] = {0, 0};
+    bool failed = false;    //a target could not be loaded, the workers stop
+    std::thread builder([&]{
+        for (std::size_t n = 0; n < target_order.size(); ++n) {
+            TargetSlot &target = targets[target_order[n]];
+            const File &file = genome1[target_order[n]];
+            if (n >= 2) {
+                const TargetSlot &previous = targets[target_order[n-2]];
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [&previous]{ return previous.remaining == 0; });
+            }
             
-            timer.split();
-            query_data = loadDataWithContentsOFile(querySeqFile, querySeqHeader);
-            progress << "Processing..." << counter << "/" << totalComparisons << "\n";
-            progress << targetSeqFile << "\n" << querySeqFile << std::endl;
+            if (target.memory > held[n % 2]) {
+                budget.reserve_shared(target.memory - held[n % 2]);
+                held[n % 2] = target.memory;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                target.state = TargetSlot::LOADING;
+                target.table = &tables[n % 2];
+            }
+            if (has_extension(file, INDEX_FILE_EXTENSION)) {
+                if (!load_target(file, target.data, target.records, *target.table, target.index)) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        failed = true;
+                    }
+                    pool.wake();
+                    return;
+                }
+            } else {
+                double waited = 0;
+                std::vector<MaskBlock> soft_masked;
+                prefetcher.take(pairs.size() + target_order[n], file, target.records, target.data, waited, options.exclude_soft_masked ? &soft_masked : NULL);
+                if (n+1 < target_order.size() && !has_extension(genome1[target_order[n+1]], INDEX_FILE_EXTENSION))
+                    prefetcher.request(pairs.size() + target_order[n+1], genome1[target_order[n+1]], options.exclude_soft_masked);
+                initializeLookupTable(*target.table, generateLookupTableIndices(target.data, soft_masked), target.records);
+            }
             
-            find_limes(target_data,query_data,target_chr);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                target.state = TargetSlot::READY;
+            }
+            pool.wake();
+        }
+    });
+    
+    //the workers block on targets and queries, their helpers are only started by idle threads
+    pool.parallel_for(pool.size(), [&](const std::size_t worker){
+        for (std::size_t k = next++; k < pairs.size(); k = next++) {
+            const Pair &pair = pairs[k];
+            TargetSlot &target = targets[pair.target];
+            const File &targetSeqFile = genome1[pair.target];
+            const File &querySeqFile = genome2[pair.query];
             
-            progress << "Processing time = " << timer.getSplitElapsedTime() << "\n" << std::endl;
+            scottgs::Timing pairTimer;
+            pairTimer.start();
+            
+            if (k+1 < pairs.size())
+                prefetcher.request(k+1, genome2[pairs[k+1].query]);
+            double target_wait = 0, query_wait = 0;
+            
+            //the builder has usually indexed the target by the time its first pair starts,
+            //otherwise this thread helps it build the table rather than sleep
+            std::unique_lock<std::mutex> lock(mutex);
+            if (target.state != TargetSlot::READY) {
+                scottgs::Timing waitTimer;
+                waitTimer.start();
+                lock.unlock();
+                pool.help_until([&]{
+                    std::lock_guard<std::mutex> targets_lock(mutex);
+                    return target.state == TargetSlot::READY || failed;
+                });
+                lock.lock();
+                target_wait = waitTimer.getTotalElapsedTime();
+            }
+            if (target.state != TargetSlot::READY)
+                return;
+            lock.unlock();
+            
+            const std::size_t memory = query_memory(querySeqFile);
+            budget.reserve(memory);
+            
+            RecordTable query_records;
+            PackedSequence query_data;
+            prefetcher.take(k, querySeqFile, query_records, query_data, query_wait);
+            
+            scottgs::Timing searchTimer;
+            searchTimer.start();
+            LimeBuffer limeObjs;
+            find_limes(*target.table, target.data, query_data, query_records, limeObjs);
+            const double search_time = searchTimer.getTotalElapsedTime();
+            const std::size_t capped = target.table->capped_size();
             
             //////////////////////////////////////
             // Write limes to file
             //////////////////////////////////////
-            if (!limeObjs_target.empty()) {
-                assert(limeObjs_target.size() == limeObjs_query.size());
-                std::sort(limeObjs_query.begin(), limeObjs_query.end());
-                std::sort(limeObjs_target.begin(), limeObjs_target.end());
-                const Limes::iterator  q_it = std::unique(limeObjs_query.begin(), limeObjs_query.end());
-                const Limes::iterator  t_it = std::unique(limeObjs_target.begin(), limeObjs_target.end());
-                
-                out << "#1" << querySeqHeader << std::endl;
-                out << "#start_1" << "\t" << "length" << std::endl;
-                std::for_each(limeObjs_query.begin(), q_it, [&out](const std::pair<std::string::size_type, int> &l){
-                    out << l.first << "\t" << l.second << std::endl;
-                });
-                out << "#2" << targetSeqHeader << std::endl;
-                out << "#start_2" << "\t" << "length" << std::endl;
-                std::for_each(limeObjs_target.begin(), t_it, [&out](const std::pair<std::string::size_type, int> &l){
-                    out << l.first << "\t" << l.second << std::endl;
-                });
-                limeObjs_target.clear();
-                limeObjs_query.clear();
+            limes_output.write(format_limes(limeObjs, query_records, target.records));
+            budget.release(memory);
+            
+            lock.lock();
+            if (--target.remaining == 0) {
+                target.table->clear();
+                target.index.close();
+                target.data.clear();
+                finished.notify_all();
             }
-            counter++;
+            
+            progress << "Processing..." << counter++ << "/" << totalComparisons << " (worker " << worker << ")" << "\n";
+            progress << targetSeqFile << "\n" << querySeqFile << "\n";
+            progress << "Waiting = " << target_wait + query_wait << " (target index " << target_wait << ", query I/O " << query_wait << ")" << "\n";
+            progress << "Search time = " << search_time << "\n";
+            progress << "Candidates = " << limeObjs.candidates << " (lookups " << limeObjs.prefilter_hits << ", skipped by prefilter " << limeObjs.prefilter_skips << ")" << "\n";
+            if (options.dust > 0)
+                progress << "Low complexity = " << (limeObjs.anchors ? 100.0*limeObjs.dust_anchors/limeObjs.anchors : 0) << "% of query anchors, at least " << limeObjs.dust_candidates << " candidates avoided" << "\n";
+            if (capped)
+                progress << "Skipped repeats = " << limeObjs.skipped_anchors << " anchors, " << limeObjs.skipped_candidates << " candidates (" << capped << " target anchors capped)" << "\n";
+            progress << "Processing time = " << pairTimer.getSplitElapsedTime() << "\n" << std::endl;
         }
-    }
+    }, true);
+    builder.join();
+    budget.release_shared(held[0] + held[1]);
+    if (failed)
+        exit(EXIT_FAILURE);
+    
     progress << "Total time = " << timer.getTotalElapsedTime() << std::endl;
     out.close();
     progress.close();
@@ -756,26 +1197,27 @@ void run(const File &file, const Files &g, const File &limes, const Progress &pr
     }
     
     timer.start();
-    limeObjs_target.reserve(100000);
-    limeObjs_query.reserve(100000);
+    LimeBuffer limeObjs;
+    limeObjs.target.reserve(100000);
+    limeObjs.query.reserve(100000);
     
     std::vector<std::pair<std::string, std::string> > target_sequences; //first=header, second=sequence
     std::vector<std::pair<std::string, std::string> > query_sequences;  //first=header, second=sequence
     
     //first parameter
-    std::ifstream in_query (file.c_str());
+    FastaReader in_query (file);
     load_next_batch(in_query, query_sequences, 1000000);
     std::vector<std::pair<std::string, std::string> >::size_type number_of_query_seq = query_sequences.size();
-    in_query.close();
     
     //second parameter
     std::vector<std::string>::size_type number_of_files = g.size();
     
-    Sequence query_sequence, target_sequence;
-    Header target_header;
+    PackedSequence target_sequence;
+    RecordTable target_records;
     
     std::ofstream out (limes.c_str());
     std::ofstream progress (progress_file.c_str());
+    IndexFile target_index;
     for (std::vector<std::string>::size_type i = 0; i < number_of_files; ++i) {
         const File target_file(g[i]);
         
@@ -784,43 +1226,35 @@ void run(const File &file, const Files &g, const File &limes, const Progress &pr
         // goal: Need to minimize vec2D generation
         //////////////////////////////////////////////
         //timer.split();
-        target_sequence = loadDataWithContentsOFile(target_file, target_header);
-        const Chromosome target_chr = generateLookupTableIndices(target_sequence);
-        initializeLookupTable(target_chr, target_sequence);
+        if (!load_target(target_file, target_sequence, target_records, vec2D, target_index))
+            exit(EXIT_FAILURE);
         //std::cout << "load and lookup table generation time: " << timer.getSplitElapsedTime() << std::endl;
         
         timer.split();
         for (std::vector<std::pair<std::string, std::string> >::size_type n = 0; n < number_of_query_seq; ++n) {
             const std::string query_header (query_sequences[n].first);
-            query_sequence = query_sequences[n].second;
+            const PackedSequence query_sequence(query_sequences[n].second);
             
-            find_limes(target_sequence,query_sequence,target_chr);
+            find_limes(vec2D, target_sequence, query_sequence, limeObjs);
             
             //////////////////////////////////////
             // Write limes to file
             //////////////////////////////////////
-            if (!limeObjs_target.empty()) {
-                assert(limeObjs_target.size() == limeObjs_query.size());
-                std::sort(limeObjs_query.begin(), limeObjs_query.end());
-                std::sort(limeObjs_target.begin(), limeObjs_target.end());
-                const Limes::iterator  q_it = std::unique(limeObjs_query.begin(), limeObjs_query.end());
-                const Limes::iterator  t_it = std::unique(limeObjs_target.begin(), limeObjs_target.end());
-                
-                out << "#1" << query_header << std::endl;
-                out << "#start_1" << "\t" << "length" << std::endl;
-                std::for_each(limeObjs_query.begin(), q_it, [&out,&query_sequence](const std::pair<std::string::size_type, int> &l){
-                    out << l.first << "\t" << l.second << std::endl;
-                });
-                out << "#2" << target_header << std::endl;
-                out << "#start_2" << "\t" << "length" << std::endl;
-                std::for_each(limeObjs_target.begin(), t_it, [&out, &target_sequence](const std::pair<std::string::size_type, int> &l){
-                    out << l.first << "\t" << l.second << std::endl;
-                });
-                limeObjs_target.clear();
-                limeObjs_query.clear();
-            }
+            RecordTable query_records;
+            query_records.add(query_header, 0);
+            out << format_limes(limeObjs, query_records, target_records);
+            limeObjs.target.clear();
+            limeObjs.query.clear();
         }
-        progress << i+1 << "/" << number_of_files << "\t" << number_of_query_seq << "\nProcessing  time = " << timer.getSplitElapsedTime() << std::endl << std::endl;
+        progress << i+1 << "/" << number_of_files << "\t" << number_of_query_seq << "\nCandidates = " << limeObjs.candidates << " (lookups " << limeObjs.prefilter_hits << ", skipped by prefilter " << limeObjs.prefilter_skips << ")" << "\n";
+        if (options.dust > 0)
+            progress << "Low complexity = " << (limeObjs.anchors ? 100.0*limeObjs.dust_anchors/limeObjs.anchors : 0) << "% of query anchors, at least " << limeObjs.dust_candidates << " candidates avoided" << "\n";
+        if (vec2D.capped_size())
+            progress << "Skipped repeats = " << limeObjs.skipped_anchors << " anchors, " << limeObjs.skipped_candidates << " candidates (" << vec2D.capped_size() << " target anchors capped)" << "\n";
+        progress << "Processing  time = " << timer.getSplitElapsedTime() << std::endl << std::endl;
+        limeObjs.candidates = limeObjs.skipped_anchors = limeObjs.skipped_candidates = 0;
+        limeObjs.anchors = limeObjs.dust_anchors = limeObjs.dust_candidates = 0;
+        limeObjs.prefilter_hits = limeObjs.prefilter_skips = 0;
     }
     progress << "Total time = " << timer.getTotalElapsedTime() << std::endl;
     out.close();
@@ -828,6 +1262,11 @@ void run(const File &file, const Files &g, const File &limes, const Progress &pr
     timer.stop();
 }
 
+/**
+ Every sequence of +queryGenome+ against every scaffold of +targetG2+, the
+ unassembled genome, which is indexed in blocks of scaffolds. Limes are written
+ per scaffold, each as a search of the queries against that scaffold alone.
+ */
 void run(const File &queryGenome, const File &targetG2, const File &limes, const File &progress_file) {
     if ( !file_exists(queryGenome)) {
         std::cerr << queryGenome << std::endl;
@@ -836,84 +1275,71 @@ void run(const File &queryGenome, const File &targetG2, const File &limes, const
     } else if (!file_exists(targetG2)) {
         std::cerr << targetG2 << std::endl;
         std::cerr << "error: path to file not found...exiting." << std::endl;
+        return ;
     }
     
     timer.start();
-    limeObjs_target.reserve(100000);
-    limeObjs_query.reserve(100000);
+    LimeBuffer limeObjs;
+    limeObjs.target.reserve(100000);
+    limeObjs.query.reserve(100000);
     
     std::vector<std::pair<std::string, std::string> > target_sequences; //first=header, second=sequence
     std::vector<std::pair<std::string, std::string> > query_sequences;  //first=header, second=sequence
     
     //query sequences
-    std::ifstream in_query (queryGenome.c_str());
+    FastaReader in_query (queryGenome);
     load_next_batch(in_query, query_sequences, 1000000);
-    in_query.close();
     
     //target sequences
-    std::ifstream in_target (targetG2.c_str());
+    FastaReader in_target (targetG2);
     load_next_batch(in_target, target_sequences, 1000000);
-    in_target.close();
-    
-    if (target_sequences.size() > query_sequences.size())
-        target_sequences.swap(query_sequences);
     
     std::vector<std::pair<std::string, std::string> >::size_type number_of_query_seq = query_sequences.size();
     std::vector<std::pair<std::string, std::string> >::size_type number_of_target_seq = target_sequences.size();
     
-    Sequence query_sequence, target_sequence;
-    std::string target_header;
-    
     std::ofstream out (limes.c_str());
     std::ofstream progress (progress_file.c_str());
     
-    scottgs::Timing outputTimer;
-    outputTimer.start();
-    for (std::vector<std::pair<std::string, std::string> >::size_type i = 0; i < number_of_target_seq; ++i) {
-        target_header = target_sequences[i].first;
-        const Sequence target_sequence = target_sequences[i].second;
-        
+    //////////////////////////////////////////////
+    // Scaffolds are packed into blocks of up to SCAFFOLD_BLOCK bases, with a
+    // RECORD_SEPARATOR between them, and each block is indexed once
+    //////////////////////////////////////////////
+    for (std::size_t first = 0, last = 0; first < number_of_target_seq; first = last) {
+        Sequence block;
+        RecordTable block_records;
+        for (last = first; last < number_of_target_seq && (last == first || block.size() + 1 + target_sequences[last].second.size() <= SCAFFOLD_BLOCK); ++last) {
+            if (last > first)
+                block.push_back(RECORD_SEPARATOR);
+            block_records.add(target_sequences[last].first, block.size());
+            block.append(target_sequences[last].second);
+        }
+        const PackedSequence target_sequence(block);
+        initializeLookupTable(vec2D, generateLookupTableIndices(target_sequence, block), block_records);
+        Sequence().swap(block);
         
-        //////////////////////////////////////////////
-        // Skips by 1 letter
-        // goal: Need to minimize vec2D generation
-        //////////////////////////////////////////////
-        const Chromosome target_chr = generateLookupTableIndices(target_sequence);
-        initializeLookupTable(target_chr, target_sequence);
+        //limes of every scaffold of the block, written in scaffold order once all queries are done
+        std::vector<std::string> scaffold_limes(last-first);
         
         timer.split();
-        for (std::vector<std::pair<std::string, std::string> >::size_type n = 0; n < number_of_query_seq; ++n) {
+        for (std::size_t n = 0; n < number_of_query_seq; ++n) {
             const std::string query_header (query_sequences[n].first);
-            query_sequence = query_sequences[n].second;
+            const PackedSequence query_sequence(query_sequences[n].second);
             
-            find_limes(target_sequence,query_sequence,target_chr);
-            
-            //////////////////////////////////////
-            // Write limes to file
-            //////////////////////////////////////
-            if (!limeObjs_target.empty()) {
-                outputTimer.split();
-                assert(limeObjs_target.size() == limeObjs_query.size());
-                std::sort(limeObjs_query.begin(), limeObjs_query.end());
-                std::sort(limeObjs_target.begin(), limeObjs_target.end());
-                const Limes::iterator  q_it = std::unique(limeObjs_query.begin(), limeObjs_query.end());
-                const Limes::iterator  t_it = std::unique(limeObjs_target.begin(), limeObjs_target.end());
-                
-                out << "#1" << query_header << std::endl;
-                out << "#start_1" << "\t" << "length" << std::endl;
-                std::for_each(limeObjs_query.begin(), q_it, [&out,&query_sequence](const std::pair<std::string::size_type, int> &l){
-                    out << l.first << "\t" << l.second << std::endl;
-                });
-                out << "#2" << target_header << std::endl;
-                out << "start_2" << "\t" << "length" << std::endl;
-                std::for_each(limeObjs_target.begin(), t_it, [&out, &target_sequence](const std::pair<std::string::size_type, int> &l){
-                    out << l.first << "\t" << l.second << std::endl;
-                });
-                limeObjs_target.clear();
-                limeObjs_query.clear();
-            }
+            find_limes(vec2D, target_sequence, query_sequence, limeObjs);
+            format_scaffold_limes(limeObjs, query_header, block_records, scaffold_limes);
         }
-        progress << i+1 << "/" << number_of_target_seq << "\t" << number_of_query_seq << "\nProcessing  time = " << timer.getSplitElapsedTime() << std::endl << std::endl;
+        for (std::size_t r = 0; r < scaffold_limes.size(); ++r)
+            out << scaffold_limes[r];
+        
+        progress << last << "/" << number_of_target_seq << "\t" << number_of_query_seq << "\nCandidates = " << limeObjs.candidates << " (lookups " << limeObjs.prefilter_hits << ", skipped by prefilter " << limeObjs.prefilter_skips << ")" << "\n";
+        if (options.dust > 0)
+            progress << "Low complexity = " << (limeObjs.anchors ? 100.0*limeObjs.dust_anchors/limeObjs.anchors : 0) << "% of query anchors, at least " << limeObjs.dust_candidates << " candidates avoided" << "\n";
+        if (vec2D.capped_size())
+            progress << "Skipped repeats = " << limeObjs.skipped_anchors << " anchors, " << limeObjs.skipped_candidates << " candidates (" << vec2D.capped_size() << " target anchors capped)" << "\n";
+        progress << "Processing  time = " << timer.getSplitElapsedTime() << std::endl << std::endl;
+        limeObjs.candidates = limeObjs.skipped_anchors = limeObjs.skipped_candidates = 0;
+        limeObjs.anchors = limeObjs.dust_anchors = limeObjs.dust_candidates = 0;
+        limeObjs.prefilter_hits = limeObjs.prefilter_skips = 0;
     }
     progress << "Total time = " << timer.getTotalElapsedTime() << std::endl;
     out.close();
@@ -921,6 +1347,126 @@ void run(const File &queryGenome, const File &targetG2, const File &limes, const
     timer.stop();
 }
 
+#pragma mark - Target index files
+/**
+ Builds the lookup table of every file in +g+ and writes it, together with the
+ packed target sequence, to <dir>/<file name>.lidx
+ */
+void build_index(const Files &g, const Path &dir_path) {
+    Path dir = dir_path;
+    if (dir.back() != '/') dir.append("/");
+    
+    if (!directory_file_exists(dir)) {
+        std::cerr << "error: index directory not found: " << dir << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    timer.start();
+    Sequence target_data;
+    RecordTable target_records;
+    for (Files::size_type i = 0; i < g.size(); ++i) {
+        const File target_file(g[i]);
+        const File index_file = dir + target_file.substr(target_file.find_last_of('/')+1) + "." + INDEX_FILE_EXTENSION;
+        
+        timer.split();
+        target_data = loadDataWithContentsOFile(target_file, target_records);
+        const Chromosome target_chr = generateLookupTableIndices(PackedSequence(target_data), target_data);
+        
+        //time of the lookup table alone, to compare --threads
+        scottgs::Timing tableTimer;
+        tableTimer.start();
+        initializeLookupTable(vec2D, target_chr, target_records);
+        const double table_time = tableTimer.getTotalElapsedTime();
+        
+        if (!IndexFile::write(index_file, target_file, target_records, target_data, vec2D))
+            exit(EXIT_FAILURE);
+        info("%lu/%lu\t%s\t%.2fs (lookup table %.2fs, %lu slices)\t%lu capped anchors\n", i+1, g.size(), index_file.c_str(), timer.getSplitElapsedTime(), table_time, LookupTable::slices(target_chr.size()), vec2D.capped_size());
+    }
+    timer.stop();
+}
+
+/**
+ Bases per second of the k-mer encoders over the sequence of +file+, the best of
+ +repeats+ runs each: encodeWord() on every word of the text, encode_word() on
+ every word of the packed sequence, the rolling encode_kmers() and the anchors
+ of both strands. The keys of encode_kmers() are checked against encodeWord().
+ */
+void bench_encode(const File &file, const int repeats) {
+    RecordTable records;
+    const Sequence text = loadDataWithContentsOFile(file, records);
+    const PackedSequence data(text);
+    const std::size_t size = data.size();
+    const std::size_t words = size >= WORDSIZE ? size-WORDSIZE+1 : 0;
+    const int chunk = SEQLENGTH/2 - WORDSIZE/2;
+    
+    const auto best = [repeats](const std::function<void()> &encode) {
+        double fastest = 0;
+        for (int r = 0; r < repeats; ++r) {
+            scottgs::Timing runTimer;
+            runTimer.start();
+            encode();
+            const double elapsed = runTimer.getTotalElapsedTime();
+            if (r == 0 || elapsed < fastest) fastest = elapsed;
+        }
+        return fastest;
+    };
+    const auto report = [size](const char *encoder, const double seconds) {
+        info("%-28s%.3fs\t%.1f Mbases/s\n", encoder, seconds, seconds > 0 ? size/seconds/1e6 : 0.0);
+    };
+    
+    Chromosome text_keys(words), word_keys(words), keys, forward, reverse;
+    info("%s\t%lu bases\n", file.c_str(), size);
+    report("encodeWord (text)", best([&]{
+        bool valid;
+        for (std::size_t i = 0; i < words; ++i) {
+            const u_int64_t key = encodeWord(reinterpret_cast<const u_char *>(text.data()+i), WORDSIZE, valid);
+            text_keys[i] = valid ? static_cast<Hash>(key) : -1;
+        }
+    }));
+    report("encode_word (packed)", best([&]{
+        for (std::size_t i = 0; i < words; ++i)
+            word_keys[i] = encode_word(data, i);
+    }));
+    report("encode_kmers (rolling)", best([&]{ encode_kmers(data, keys); }));
+    report("encode_anchors (strided)", best([&]{ encode_anchors(data, chunk, forward, reverse); }));
+    
+    if (keys != text_keys || keys != word_keys)
+        std::cerr << "error: encode_kmers() keys differ from encodeWord()" << std::endl;
+}
+
+/**
+ Build time of the lookup table of +file+ on 1 to --threads threads, the best of
+ +repeats+ builds each, and the speedup over one thread. The tables are built
+ as with --sliced-build.
+ */
+void bench_lookup_table(const File &file, const int repeats) {
+    RecordTable records;
+    const Sequence sequence = loadDataWithContentsOFile(file, records);
+    const Chromosome keys = generateLookupTableIndices(PackedSequence(sequence), sequence);
+    
+    options.sliced_build = true;
+    ThreadPool &pool = thread_pool();
+    const unsigned threads = pool.size();
+    info("%s\t%lu bases, %u hardware threads\n", file.c_str(), sequence.size(), std::thread::hardware_concurrency());
+    
+    LookupTable table;
+    double serial = 0;
+    for (unsigned t = 1; t <= threads; ++t) {
+        pool.limit(t);
+        double fastest = 0;
+        for (int r = 0; r < repeats; ++r) {
+            scottgs::Timing buildTimer;
+            buildTimer.start();
+            initializeLookupTable(table, keys, records);
+            const double elapsed = buildTimer.getTotalElapsedTime();
+            if (r == 0 || elapsed < fastest) fastest = elapsed;
+        }
+        if (t == 1) serial = fastest;
+        info("%u threads\t%lu slices\t%.3fs\t%.2fx\n", t, LookupTable::slices(keys.size()), fastest, fastest > 0 ? serial/fastest : 0.0);
+    }
+    pool.limit(threads);
+}
+
 #pragma mark -
 
 
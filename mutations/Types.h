@@ -16,17 +16,27 @@
 #include <math.h>
 #include <stdarg.h>
 #include <cstdarg>
+#include <sys/types.h>
 
 #pragma mark - Definitions
 #define WORDSIZE 12
 #define SEQLENGTH 100
 
+//every anchor is stored once, under its begin word
+#define LOOKUP_ENTRIES_PER_ANCHOR 1
+
 #define BA_ENCODED_A 0x00
 #define BA_ENCODED_C 0x01
 #define BA_ENCODED_G 0x02
 #define BA_ENCODED_T 0x03
 
+//words of up to 15 bases keep a positive int key, longer ones (up to 31) need 64 bits
+#if WORDSIZE > 15
+typedef long long Hash;
+#else
 typedef int Hash;
+#endif
+static_assert(WORDSIZE <= 31, "a word must fit in 62 bits");
 typedef int Location;
 typedef int FirstMutation;
 typedef int SecondMutation;
@@ -48,20 +58,55 @@ typedef std::string Extension;
 typedef std::vector<File> Files;
 
 
+#if WORDSIZE <= 16
+/**
+ Index entry packed in 64 bits, the end word (id) in the high ELEMENT_ID_BITS and
+ the target position (idx) below it. Ordering the raw bits orders by id, then idx.
+ */
+#define ELEMENT_ID_BITS (2*WORDSIZE)
+#define ELEMENT_IDX_BITS (64 - ELEMENT_ID_BITS)
+#define ELEMENT_IDX_MASK ((static_cast<u_int64_t>(1) << ELEMENT_IDX_BITS) - 1)
+
 class Element {
 public:
-    Element() : id(-1), idx(-1){}
-    Element(const Hash ID, const std::size_t index) : id(ID), idx(index){}
+    Element() : bits(~static_cast<u_int64_t>(0)) {}
+    Element(const Hash ID, const std::size_t index) : bits(static_cast<u_int64_t>(ID) << ELEMENT_IDX_BITS | static_cast<u_int64_t>(index)) {}
     void operator()(const Hash ID, const std::size_t index){
-        id = ID;
-        idx = index;
+        bits = static_cast<u_int64_t>(ID) << ELEMENT_IDX_BITS | static_cast<u_int64_t>(index);
     }
-    int id;
-    std::size_t idx;
+    bool operator<(const Element &other) const { return bits < other.bits; }
+    
+    Hash id() const { return static_cast<Hash>(bits >> ELEMENT_IDX_BITS); }
+    std::size_t idx() const { return static_cast<std::size_t>(bits & ELEMENT_IDX_MASK); }
+    
+    u_int64_t bits;
 };
+static_assert(sizeof(Element) == 8, "an Element is one 64 bit word");
+#else
+/**
+ Longer end words leave too few bits for a position, id and idx get a word each
+ */
+#define ELEMENT_IDX_BITS 64
+#define ELEMENT_IDX_MASK (~static_cast<u_int64_t>(0))
+
+class Element {
+public:
+    Element() : key(~static_cast<u_int64_t>(0)), position(~static_cast<u_int64_t>(0)) {}
+    Element(const Hash ID, const std::size_t index) : key(static_cast<u_int64_t>(ID)), position(index) {}
+    void operator()(const Hash ID, const std::size_t index){
+        key = static_cast<u_int64_t>(ID);
+        position = index;
+    }
+    bool operator<(const Element &other) const { return key < other.key || (key == other.key && position < other.position); }
+    
+    Hash id() const { return static_cast<Hash>(key); }
+    std::size_t idx() const { return static_cast<std::size_t>(position); }
+    
+    u_int64_t key, position;
+};
+#endif
 typedef std::vector<Element> Pos;
 typedef Pos Elements;
-typedef std::vector<Pos> LookupTable;
 
 class Candidate {
 public:
@@ -70,6 +115,9 @@ public:
     
     //idx_1 is the index from first chromosome, and idx_2 is the index from the second chromosome
     std::size_t idx_1, idx_2;
+    
+    //anchors of one ungapped match share idx_2 - idx_1
+    long diagonal() const { return static_cast<long>(idx_2) - static_cast<long>(idx_1); }
 };
 typedef std::vector<Candidate> Candidates;
 #pragma mark - 
@@ -8,6 +8,56 @@
 
 #include "Util.h"
 
+#include <thread>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+Options options;
+
+Options::Options() : threads(std::thread::hardware_concurrency()), memory(static_cast<std::size_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE)), max_occurrences(0), exclude_soft_masked(false), dust(0), whole_genome(false), sliced_build(false) {
+    if (threads == 0) threads = 1;
+}
+
+/**
+ Consumes the --name=value options from +argv+, leaving the positional arguments in place
+ */
+bool parse_options(int &argc, const char *argv[]) {
+    int n = 1;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg.compare(0, 2, "--") != 0) {
+            argv[n++] = argv[i];
+            continue;
+        }
+        
+        const std::string::size_type eq = arg.find('=');
+        const std::string name = arg.substr(2, eq == arg.npos ? arg.npos : eq-2);
+        const std::string value = eq == arg.npos ? "" : arg.substr(eq+1);
+        
+        if (name == "threads" && atoi(value.c_str()) > 0) {
+            options.threads = atoi(value.c_str());
+        } else if (name == "memory" && atol(value.c_str()) > 0) {
+            options.memory = static_cast<std::size_t>(atol(value.c_str())) << 20;
+        } else if (name == "max-occurrences" && atol(value.c_str()) > 0) {
+            options.max_occurrences = static_cast<std::size_t>(atol(value.c_str()));
+        } else if (name == "exclude-soft-masked" && eq == arg.npos) {
+            options.exclude_soft_masked = true;
+        } else if (name == "dust" && atof(value.c_str()) > 0) {
+            options.dust = atof(value.c_str());
+        } else if (name == "whole-genome" && eq == arg.npos) {
+            options.whole_genome = true;
+        } else if (name == "sliced-build" && eq == arg.npos) {
+            options.sliced_build = true;
+        } else {
+            std::cerr << "error: unknown or invalid option " << arg << std::endl;
+            return false;
+        }
+    }
+    argc = n;
+    return true;
+}
+
 bool isAssembled(const File &file) {
     return !(file.find("dna.nonchromosomal") != file.npos);
 }
@@ -32,6 +82,16 @@ bool file_exists(const Path &path_to_file) {
     return false;
 }
 
+bool has_extension(const File &file, const Extension &ext) {
+    const Extension file_extension = "." + ext;
+    return file.length() >= file_extension.length() && file.compare(file.length()-file_extension.length(), file_extension.length(), file_extension) == 0;
+}
+
+std::size_t file_size(const File &file) {
+    struct stat st;
+    return stat(file.c_str(), &st) == 0 ? static_cast<std::size_t>(st.st_size) : 0;
+}
+
 bool directory_file_exists(const Path &path_to_file) {
     struct stat st;
     
@@ -0,0 +1,225 @@
+//
+//  test_extension.cpp
+//
+//  Randomized differential test of the packed extensions in Extension.cpp
+//  against the offset() functions they replaced, which extended over the text
+//  with std::mismatch. Build and run from this directory with
+//
+//      g++ -std=c++11 -O2 -I.. -o test_extension test_extension.cpp ../Extension.cpp ../PackedSequence.cpp ../Encoding.cpp && ./test_extension [iterations] [seed]
+//
+//  The text is uppercase ACGT and N, the alphabet on which the two agree: the
+//  packed extensions ignore case and stop at any base other than ACGT, where
+//  offset() compared the bytes as they are and only stopped at N.
+//
+
+#include "Extension.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <cstdlib>
+
+#pragma mark - Text extensions
+/**
+ The forward offset(): length of the common extension from +first1+ and +first2+
+ with one mismatch, stopping at an N
+ */
+long offset(std::string::const_iterator first1, std::string::const_iterator last1, std::string::const_iterator first2, int &mut_pos) {
+    std::pair<std::string::const_iterator, std::string::const_iterator> pair;
+
+    int count = 0, pos = 0, tmp = 0;
+
+    pair = std::mismatch(first1, last1, first2, [&count,&pos,&tmp](char a, char b) {
+        if (a=='N' || b=='N') {
+            if(count==0) tmp=pos;
+            return false;
+        } else if (a!=b) {
+            count++;
+            if (count<2)
+                tmp=pos;
+        }
+        pos++;
+        return count<2;
+    });
+
+    if(count==0)
+        tmp=pos;
+
+    mut_pos=tmp;
+
+    return  std::distance(first1, pair.first);
+}
+
+/**
+ The reverse offset(), a first mismatch at position 0 is reported as 1
+ */
+long offset(std::string::const_reverse_iterator first1, std::string::const_reverse_iterator last1, std::string::const_reverse_iterator first2, int &mut_pos) {
+    std::pair<std::string::const_reverse_iterator, std::string::const_reverse_iterator> pair;
+
+    int count = 0, pos = 0, tmp = 0;
+
+    pair = std::mismatch(first1, last1, first2, [&count,&pos,&tmp](char a, char b) {
+        if (a=='N' || b=='N') {
+            if(count==0) tmp=pos;
+            return false;
+        } else if (a!=b) {
+            count++;
+            if (count<2)
+                tmp = !pos ? 1 : pos;
+        }
+        pos++;
+        return count<2;
+    });
+
+    if(count==0)
+        tmp=pos;
+
+    mut_pos = tmp;
+
+    return  std::distance(first1, pair.first);
+}
+
+std::string reverse_complement(const std::string &s) {
+    std::string rc(s.rbegin(), s.rend());
+    for (std::string::size_type i = 0; i < rc.size(); ++i) {
+        switch (rc[i]) {
+            case 'A': rc[i] = 'T'; break;
+            case 'C': rc[i] = 'G'; break;
+            case 'G': rc[i] = 'C'; break;
+            case 'T': rc[i] = 'A'; break;
+            default: break;
+        }
+    }
+    return rc;
+}
+
+#pragma mark - Random sequences
+std::mt19937 generator;
+
+std::size_t uniform(const std::size_t n) {
+    return n ? std::uniform_int_distribution<std::size_t>(0, n-1)(generator) : 0;
+}
+
+char random_base() {
+    return "ACGT"[uniform(4)];
+}
+
+char other_base(const char c) {
+    char b;
+    while ((b = random_base()) == c);
+    return b;
+}
+
+/**
+ +a+ and +b+, a copy of it after up to 39 random bases with a few mismatches.
+ A few Ns go in either. The shift has the two read at different offsets within
+ their packed words.
+ */
+void random_pair(std::string &a, std::string &b) {
+    const std::size_t length = 1 + uniform(uniform(8) ? 300 : 2000);
+    a.resize(length);
+    for (std::size_t i = 0; i < length; ++i)
+        a[i] = random_base();
+
+    const std::size_t shift = uniform(40);
+    b = std::string(shift, 'A') + a;
+    for (std::size_t i = 0; i < b.size(); ++i)
+        b[i] = random_base();
+    b.replace(shift, a.size(), a);
+
+    const std::size_t mismatches = uniform(6), ns = uniform(3);
+    for (std::size_t m = 0; m < mismatches; ++m) {
+        char &c = b[shift + uniform(length)];
+        c = other_base(c);
+    }
+    for (std::size_t m = 0; m < ns; ++m)
+        (uniform(2) ? a[uniform(length)] : b[shift + uniform(length)]) = 'N';
+}
+
+#pragma mark -
+struct Check {
+    Check() : cases(0), failures(0) {}
+
+    void compare(const char *direction, const long expected, const int expected_mut, const long got, const int got_mut, const std::string &a, const std::string &b, const std::size_t pa, const std::size_t pb) {
+        ++cases;
+        if (expected == got && expected_mut == got_mut) return;
+        if (++failures > 10) return;
+        std::cerr << "error: " << direction << " pa=" << pa << " pb=" << pb << ": offset() " << expected << "/" << expected_mut << ", extension " << got << "/" << got_mut << std::endl;
+        std::cerr << "  a=" << a << std::endl << "  b=" << b << std::endl;
+    }
+
+    std::size_t cases, failures;
+};
+
+/**
+ Every extension from (+pa+, +pb+) both ways, and with +a+ read through its
+ reverse complement
+ */
+void check_extensions(const std::string &a, const std::string &b, const std::size_t pa, const std::size_t pb, Check &check) {
+    const PackedSequence packed_a(a), packed_b(b);
+    const std::string rc = reverse_complement(a);
+    int expected_mut = 0, got_mut = 0;
+    long expected, got;
+
+    std::size_t n = std::min(a.size()-pa, b.size()-pb);
+    expected = offset(a.cbegin()+pa, a.cbegin()+pa+n, b.cbegin()+pb, expected_mut);
+    got = extend_forward(packed_a, pa, packed_b, pb, n, got_mut);
+    check.compare("forward", expected, expected_mut, got, got_mut, a, b, pa, pb);
+
+    n = std::min(pa, pb);
+    expected = offset(a.crbegin()+(a.size()-pa), a.crbegin()+(a.size()-pa)+n, b.crbegin()+(b.size()-pb), expected_mut);
+    got = extend_reverse(packed_a, pa, packed_b, pb, n, got_mut);
+    check.compare("reverse", expected, expected_mut, got, got_mut, a, b, pa, pb);
+
+    n = std::min(pa, b.size()-pb);
+    expected = offset(rc.cbegin()+(a.size()-pa), rc.cbegin()+(a.size()-pa)+n, b.cbegin()+pb, expected_mut);
+    got = extend_forward_rc(packed_a, pa, packed_b, pb, n, got_mut);
+    check.compare("forward rc", expected, expected_mut, got, got_mut, a, b, pa, pb);
+
+    n = std::min(a.size()-pa, pb);
+    expected = offset(rc.crbegin()+pa, rc.crbegin()+pa+n, b.crbegin()+(b.size()-pb), expected_mut);
+    got = extend_reverse_rc(packed_a, pa, packed_b, pb, n, got_mut);
+    check.compare("reverse rc", expected, expected_mut, got, got_mut, a, b, pa, pb);
+}
+
+int main(int argc, const char * argv[]) {
+    const std::size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    generator.seed(argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 1);
+
+    Check check;
+    std::string a, b, rc_a;
+    for (std::size_t it = 0; it < iterations; ++it) {
+        random_pair(a, b);
+        const std::size_t shift = b.size() - a.size();
+
+        //the copy of a in b, anywhere else in b, and the ends of both
+        const std::size_t pa = uniform(a.size()+1);
+        check_extensions(a, b, pa, shift + pa, check);
+        check_extensions(a, b, uniform(a.size()+1), uniform(b.size()+1), check);
+        check_extensions(a, b, 0, shift, check);
+        check_extensions(a, b, a.size(), b.size(), check);
+
+        //a mismatch at the first base of each direction and at the last base of the buffer
+        std::string c = b;
+        c[shift + pa - (pa == a.size())] = a[pa - (pa == a.size())] == 'N' ? 'N' : other_base(a[pa - (pa == a.size())]);
+        check_extensions(a, c, pa, shift + pa, check);
+        if (pa > 0) {
+            c = b;
+            c[shift + pa - 1] = a[pa-1] == 'N' ? 'N' : other_base(a[pa-1]);
+            check_extensions(a, c, pa, shift + pa, check);
+        }
+        c = b;
+        c[b.size()-1] = other_base(c[b.size()-1]);
+        check_extensions(a, c, pa, shift + pa, check);
+
+        //the copy of the reverse complement of a in b, extended through the rc variants
+        rc_a = reverse_complement(a);
+        c = b;
+        c.replace(shift, rc_a.size(), rc_a);
+        const std::size_t pc = uniform(a.size()+1);
+        check_extensions(a, c, a.size()-pc, shift + pc, check);
+    }
+
+    std::cout << check.cases << " extensions, " << check.failures << " differ from offset()" << std::endl;
+    return check.failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
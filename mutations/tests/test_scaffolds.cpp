@@ -0,0 +1,139 @@
+//
+//  test_scaffolds.cpp
+//
+//  Regression run of `Limes scaffolds`: random scaffolds sharing stretches
+//  with a few query sequences, some of them right at a scaffold's ends, are
+//  searched in blocks of SCAFFOLD_BLOCK bases and one scaffold at a time. The
+//  limes files must be identical. Build with a small block so that a block
+//  holds several scaffolds and the run takes several blocks, and run from
+//  this directory with
+//
+//      g++ -std=c++11 -O2 -pthread -DSCAFFOLD_BLOCK=16384 -I.. -o test_scaffolds test_scaffolds.cpp $(ls ../*.cpp | grep -v main.cpp) -lz && ./test_scaffolds [scaffolds] [seed]
+//
+//  Without --max-occurrences: it counts repeats across a whole block.
+//
+
+#include "Serial.h"
+
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+
+#pragma mark - Random sequences
+std::mt19937 generator;
+
+std::size_t uniform(const std::size_t n) {
+    return n ? std::uniform_int_distribution<std::size_t>(0, n-1)(generator) : 0;
+}
+
+std::string random_sequence(const std::size_t length) {
+    std::string s(length, 'A');
+    for (std::size_t i = 0; i < length; ++i)
+        s[i] = "ACGT"[uniform(4)];
+    return s;
+}
+
+std::string reverse_complement(const std::string &s) {
+    std::string rc(s.rbegin(), s.rend());
+    for (std::string::size_type i = 0; i < rc.size(); ++i) {
+        switch (rc[i]) {
+            case 'A': rc[i] = 'T'; break;
+            case 'C': rc[i] = 'G'; break;
+            case 'G': rc[i] = 'C'; break;
+            case 'T': rc[i] = 'A'; break;
+            default: break;
+        }
+    }
+    return rc;
+}
+
+/**
+ A stretch of +s+ of 150 to 650 bases with a mismatch every 200 bases or so, on
+ either strand. Every third one is taken from the start or the end of +s+.
+ */
+std::string random_copy(const std::string &s) {
+    const std::size_t length = std::min<std::size_t>(s.size(), 150 + uniform(500));
+    const std::size_t start = uniform(3) ? uniform(s.size() - length + 1) : (uniform(2) ? 0 : s.size() - length);
+    std::string copy = s.substr(start, length);
+    for (std::size_t m = 0; m < length/200; ++m) {
+        char &c = copy[uniform(length)];
+        c = c == 'A' ? 'C' : 'A';
+    }
+    return uniform(2) ? copy : reverse_complement(copy);
+}
+
+#pragma mark - Files
+void write_fasta(const File &path, const std::vector<std::pair<Header, Sequence> > &records) {
+    std::ofstream out(path.c_str());
+    for (std::size_t r = 0; r < records.size(); ++r) {
+        out << ">" << records[r].first << "\n";
+        for (std::size_t i = 0; i < records[r].second.size(); i += 60)
+            out << records[r].second.substr(i, 60) << "\n";
+    }
+}
+
+std::string read_file(const File &path) {
+    std::ifstream in(path.c_str());
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+int main(int argc, const char * argv[]) {
+    const std::size_t number_of_scaffolds = argc > 1 ? strtoul(argv[1], NULL, 10) : 24;
+    generator.seed(argc > 2 ? static_cast<unsigned>(strtoul(argv[2], NULL, 10)) : 1);
+
+    char dir_template[] = "/tmp/test_scaffolds.XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        std::cerr << "error: unable to create a temporary directory" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const Path dir(dir_template);
+
+    //scaffolds of 200 to 4200 bases, and queries made of random bases and copies from them
+    std::vector<std::pair<Header, Sequence> > scaffolds, queries(3);
+    std::size_t bases = 0;
+    for (std::size_t r = 0; r < number_of_scaffolds; ++r) {
+        scaffolds.push_back(std::make_pair("scaffold" + std::to_string(r), random_sequence(200 + uniform(4000))));
+        bases += scaffolds.back().second.size();
+    }
+    for (std::size_t q = 0; q < queries.size(); ++q) {
+        queries[q].first = "query" + std::to_string(q);
+        for (std::size_t c = 0; c < number_of_scaffolds; ++c)
+            queries[q].second += random_sequence(uniform(300)) + random_copy(scaffolds[uniform(number_of_scaffolds)].second);
+    }
+    write_fasta(dir + "/queries.fa", queries);
+    write_fasta(dir + "/scaffolds.fa", scaffolds);
+
+    //the log lines of both runs are not compared
+    std::ofstream log((dir + "/log").c_str());
+    std::streambuf *out = std::cout.rdbuf(log.rdbuf());
+
+    run(File(dir + "/queries.fa"), File(dir + "/scaffolds.fa"), dir + "/blocks.limes", dir + "/blocks.progress");
+    std::string expected;
+    for (std::size_t r = 0; r < number_of_scaffolds; ++r) {
+        const File scaffold = dir + "/" + scaffolds[r].first + ".fa";
+        write_fasta(scaffold, std::vector<std::pair<Header, Sequence> >(1, scaffolds[r]));
+        run(File(dir + "/queries.fa"), scaffold, dir + "/scaffold.limes", dir + "/scaffold.progress");
+        expected += read_file(dir + "/scaffold.limes");
+    }
+    std::cout.rdbuf(out);
+
+    const std::string blocks = read_file(dir + "/blocks.limes");
+    const std::size_t limes = std::count(expected.begin(), expected.end(), '\n');
+    std::cout << number_of_scaffolds << " scaffolds, " << bases << " bases in blocks of " << SCAFFOLD_BLOCK << ", " << limes << " lines of limes" << std::endl;
+    if (limes == 0 || bases <= SCAFFOLD_BLOCK) {
+        std::cerr << "error: the scaffolds must have limes and take more than one block" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (blocks != expected) {
+        std::cerr << "error: limes of the scaffold blocks differ from those of each scaffold alone, see " << dir << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string command = "rm -rf " + dir;
+    if (system(command.c_str()) != 0)
+        std::cerr << "warning: unable to remove " << dir << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -7,100 +7,666 @@
 //
 
 #include "IO.h"
+#include "ThreadPool.h"
+#include "Util.h"
 
-Sequence loadDataWithContentsOFile(const File &file, Header &header) {
-    std::ifstream in(file.c_str());
-    if (in.is_open()) {
-        // info("Loading file %s...\n", file.c_str());
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+//unmapped in steps of at least this many bytes
+static const std::size_t RELEASE_STEP = 64 << 20;
+
+//bytes inflated per chunk of a gzip file
+static const std::size_t GZIP_CHUNK = 4 << 20;
+
+//blocks inflated per chunk of a bgzip file, at most 64KB each
+static const std::size_t BGZF_BATCH = 512;
+
+//bytes handed to zlib per call, avail_in is 32 bits
+static const std::size_t ZLIB_STEP = 1 << 30;
+
+#pragma mark - Mapped files
+MappedFile::MappedFile(const File &file) : opened(false), data(NULL), length(0), released(NULL) {
+    const int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        length = st.st_size;
+        opened = true;
+        if (length) {
+            void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                opened = false;
+                length = 0;
+            } else {
+                data = released = static_cast<char *>(addr);
+                madvise(data, length, MADV_SEQUENTIAL);
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data && released < data + length)
+        munmap(released, data + length - released);
+}
+
+/**
+ Unmaps in steps of RELEASE_STEP
+ */
+void MappedFile::release(const char *consumed) {
+    static const std::size_t page = sysconf(_SC_PAGESIZE);
+    if (static_cast<std::size_t>(consumed - released) < RELEASE_STEP) return;
+    
+    char *upto = data + (static_cast<std::size_t>(consumed - data) / page) * page;
+    if (upto > released) {
+        munmap(released, upto - released);
+        released = upto;
+    }
+}
+
+#pragma mark - 2bit reader
+#define TWOBIT_SIGNATURE 0x1A412743
+
+static bool twobit_signature(const unsigned char *p, const std::size_t n) {
+    if (n < 4) return false;
+    u_int32_t signature;
+    memcpy(&signature, p, sizeof(signature));
+    return signature == TWOBIT_SIGNATURE || signature == __builtin_bswap32(TWOBIT_SIGNATURE);
+}
+
+namespace {
+    /**
+     The 4 bases of every packed byte, T C A G for 0-3 and the first base in the high bits
+     */
+    struct TwoBitBases {
+        char bases[256][4];
+        TwoBitBases() {
+            static const char symbol[] = {'T', 'C', 'A', 'G'};
+            for (int b = 0; b < 256; ++b)
+                for (int i = 0; i < 4; ++i)
+                    bases[b][i] = symbol[(b >> (2*(3-i))) & 0x03];
+        }
+    };
+}
+static const TwoBitBases twobit_bases;
+
+namespace {
+    /**
+     The BA_ENCODED_* codes of the 4 bases of every packed byte, the first base
+     in the low bits as PackedSequence keeps them
+     */
+    struct TwoBitCodes {
+        u_char bytes[256];
+        TwoBitCodes() {
+            static const u_char code[] = {BA_ENCODED_T, BA_ENCODED_C, BA_ENCODED_A, BA_ENCODED_G};
+            for (int b = 0; b < 256; ++b) {
+                bytes[b] = 0;
+                for (int i = 0; i < 4; ++i)
+                    bytes[b] |= code[(b >> (2*(3-i))) & 0x03] << 2*i;
+            }
+        }
+    };
+}
+static const TwoBitCodes twobit_codes;
+
+TwoBitReader::TwoBitReader(MappedFile *f) : in(f), swapped(false), valid(false), current(0) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(in->data);
+    if (in->length < 16 || !twobit_signature(p, in->length)) return;
+    
+    u_int32_t signature;
+    memcpy(&signature, p, sizeof(signature));
+    swapped = signature != TWOBIT_SIGNATURE;
+    
+    std::size_t pos = 4;
+    const u_int32_t version = read32(pos);
+    const u_int32_t count = read32(pos);
+    pos += 4;
+    if (version > 1) return;
+    
+    //version 1 has 64-bit offsets
+    for (u_int32_t i = 0; i < count; ++i) {
+        if (pos >= in->length) return;
+        const std::size_t name_size = p[pos++];
+        if (pos + name_size + (version ? 8 : 4) > in->length) return;
         
-        in.seekg (0, in.end);
-        long length = in.tellg();
-        //info("file size = %d\n",length);
+        const Header name = ">" + Header(in->data + pos, name_size);
+        pos += name_size;
+        index.push_back(std::make_pair(name, version ? read64(pos) : read32(pos)));
+    }
+    valid = true;
+}
+
+TwoBitReader::~TwoBitReader() {
+    delete in;
+}
+
+u_int32_t TwoBitReader::read32(std::size_t &pos) const {
+    u_int32_t value = 0;
+    if (pos + sizeof(value) <= in->length)
+        memcpy(&value, in->data + pos, sizeof(value));
+    pos += sizeof(value);
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+u_int64_t TwoBitReader::read64(std::size_t &pos) const {
+    u_int64_t value = 0;
+    if (pos + sizeof(value) <= in->length)
+        memcpy(&value, in->data + pos, sizeof(value));
+    pos += sizeof(value);
+    return swapped ? __builtin_bswap64(value) : value;
+}
+
+/**
+ Moves on to the next sequence, false once there are none left
+ */
+bool TwoBitReader::next_record(Header &header, Record &record) {
+    if (current >= index.size()) return false;
+    header = index[current].first;
+    std::size_t pos = index[current++].second;
+    
+    record.size = read32(pos);
+    record.number_of_n_blocks = read32(pos);
+    record.n_blocks = pos;
+    pos += 2*sizeof(u_int32_t)*record.number_of_n_blocks;
+    record.number_of_mask_blocks = read32(pos);
+    record.mask_blocks = pos;
+    pos += 2*sizeof(u_int32_t)*record.number_of_mask_blocks + sizeof(u_int32_t);
+    record.packed = pos;
+    
+    if (pos + (record.size+3)/4 > in->length) {
+        std::cerr << "error: truncated .2bit file, sequence " << header.substr(1) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+/**
+ Block +b+ of the +count+ starts followed by as many lengths at +blocks+,
+ clipped to a sequence of +size+ bases
+ */
+void TwoBitReader::block(const std::size_t blocks, const u_int32_t count, const u_int32_t b, const u_int32_t size, std::size_t &first, std::size_t &length) const {
+    std::size_t start = blocks + sizeof(u_int32_t)*b, n = start + sizeof(u_int32_t)*count;
+    first = std::min<std::size_t>(size, read32(start));
+    length = std::min<std::size_t>(size - first, read32(n));
+}
+
+/**
+ The next sequence, its N blocks as N and its mask blocks in lowercase like
+ twoBitToFa, so they are skipped by the anchors as in the fasta file
+ */
+bool TwoBitReader::next(Header &header, Sequence &sequence) {
+    Record record;
+    if (!next_record(header, record)) return false;
+    
+    const u_int32_t size = record.size;
+    const unsigned char *packed = reinterpret_cast<const unsigned char *>(in->data + record.packed);
+    sequence.resize(size);
+    for (u_int32_t i = 0; i < size/4; ++i)
+        memcpy(&sequence[4*i], twobit_bases.bases[packed[i]], 4);
+    for (u_int32_t i = size/4*4; i < size; ++i)
+        sequence[i] = twobit_bases.bases[packed[i/4]][i%4];
+    
+    std::size_t first, length;
+    for (u_int32_t b = 0; b < record.number_of_n_blocks; ++b) {
+        block(record.n_blocks, record.number_of_n_blocks, b, size, first, length);
+        std::fill(sequence.begin() + first, sequence.begin() + first + length, 'N');
+    }
+    for (u_int32_t b = 0; b < record.number_of_mask_blocks; ++b) {
+        block(record.mask_blocks, record.number_of_mask_blocks, b, size, first, length);
+        for (std::size_t i = first; i < first + length; ++i)
+            sequence[i] = tolower(sequence[i]);
+    }
+    
+    return true;
+}
+
+/**
+ Appends the next sequence to +sequence+ without unpacking it, its N blocks
+ ambiguous. Its mask blocks, at their place in +sequence+, are added to
+ +soft_masked+ when given.
+ */
+bool TwoBitReader::append(Header &header, PackedSequence &sequence, std::vector<MaskBlock> *soft_masked) {
+    Record record;
+    if (!next_record(header, record)) return false;
+    
+    const std::size_t start = sequence.size();
+    sequence.append_packed(in->data + record.packed, record.size, twobit_codes.bytes);
+    
+    std::size_t first, length;
+    for (u_int32_t b = 0; b < record.number_of_n_blocks; ++b) {
+        block(record.n_blocks, record.number_of_n_blocks, b, record.size, first, length);
+        sequence.set_ambiguous(start + first, length);
+    }
+    for (u_int32_t b = 0; soft_masked && b < record.number_of_mask_blocks; ++b) {
+        block(record.mask_blocks, record.number_of_mask_blocks, b, record.size, first, length);
+        if (length) {
+            const MaskBlock mask = {start + first, length};
+            soft_masked->push_back(mask);
+        }
+    }
+    
+    return true;
+}
+
+#pragma mark - Fasta sources
+namespace {
+    inline u_int32_t little_endian_16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+    inline u_int32_t little_endian_32(const unsigned char *p) { return little_endian_16(p) | (little_endian_16(p+2) << 16); }
+    
+    bool is_gzip(const MappedFile &in) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(in.data);
+        return in.length >= 2 && p[0] == 0x1f && p[1] == 0x8b;
+    }
+    
+    /**
+     Size of the BGZF block at +p+ (a gzip member whose extra field holds its
+     size in a BC subfield), false if +p+ is not one
+     */
+    bool bgzf_block_size(const unsigned char *p, const std::size_t n, std::size_t &size) {
+        if (n < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4)) return false;
         
-        Sequence content;
-        content.resize(length);
-        in.seekg (0, in.beg);
-        in.read(&content[0], content.size());
-        in.close();
-        // info("string length = %d\n",content.length());
-        // info("numer of charaters extracted = %d\n",in.gcount());
+        const std::size_t xlen = little_endian_16(p + 10);
+        if (12 + xlen > n) return false;
+        for (std::size_t i = 12; i + 4 <= 12 + xlen; i += 4 + little_endian_16(p + i + 2)) {
+            if (p[i] == 'B' && p[i+1] == 'C' && little_endian_16(p + i + 2) == 2) {
+                size = little_endian_16(p + i + 4) + 1;
+                return size >= 12 + xlen + 8 && size <= n;
+            }
+        }
+        return false;
+    }
+    
+    /**
+     Plain fasta file, one chunk with the whole mapping
+     */
+    class MappedSource : public FastaSource {
+    public:
+        explicit MappedSource(MappedFile *f) : in(f), done(false) {}
         
-        // get sequence header
-        size_t pos = content.find("\n");
-        header = content.substr(0,pos);
+        bool fill(const char *&begin, const char *&end) {
+            if (done || !in->length) return false;
+            done = true;
+            begin = in->data;
+            end = in->data + in->length;
+            return true;
+        }
         
-        // remove fasta header (assumes sequence has header file)
-        Sequence::iterator it = std::find(content.begin(), content.end(), '\n');
-        content.erase(content.begin(), it+1);
+        void consumed(const char *upto) { in->release(upto); }
         
-        // remove newline characters
-        content.erase(std::remove(content.begin(), content.end(), '\n'), content.end());
+    private:
+        std::unique_ptr<MappedFile> in;
+        bool done;
+    };
+    
+    /**
+     gzip file, possibly of several members, inflated GZIP_CHUNK at a time.
+     A gzip stream can only be inflated from its start, so this is serial.
+     */
+    class GzipSource : public FastaSource {
+    public:
+        GzipSource(MappedFile *f, const File &name) : in(f), file(name), fed(0), finished(false), buffer(GZIP_CHUNK) {
+            memset(&stream, 0, sizeof(stream));
+            inflateInit2(&stream, 15 + 32);
+        }
         
-        // remove invalid characters such as 'N'
-        // content.erase(std::remove(content.begin(), content.end(), 'N'), content.end());
+        ~GzipSource() { inflateEnd(&stream); }
         
-        // info("Done loading %s.\n", file.c_str());
-        return content;
-    } else {
-        info("Check file: %s\n", file.c_str());
-        exit(EXIT_FAILURE);
-    }
+        bool fill(const char *&begin, const char *&end) {
+            stream.next_out = reinterpret_cast<Bytef *>(&buffer[0]);
+            stream.avail_out = static_cast<uInt>(buffer.size());
+            
+            while (stream.avail_out && !finished) {
+                if (stream.avail_in == 0 && fed < in->length) {
+                    const std::size_t n = std::min(ZLIB_STEP, in->length - fed);
+                    stream.next_in = reinterpret_cast<Bytef *>(in->data + fed);
+                    stream.avail_in = static_cast<uInt>(n);
+                    fed += n;
+                }
+                
+                const int status = inflate(&stream, Z_NO_FLUSH);
+                if (status == Z_STREAM_END) {
+                    //another member may follow
+                    if (stream.avail_in == 0 && fed == in->length) finished = true;
+                    else inflateReset(&stream);
+                } else if (status != Z_OK) {
+                    std::cerr << "error: " << file << " is not a valid gzip file" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                in->release(reinterpret_cast<const char *>(stream.next_in));
+            }
+            
+            begin = &buffer[0];
+            end = begin + (buffer.size() - stream.avail_out);
+            return begin < end;
+        }
+        
+    private:
+        std::unique_ptr<MappedFile> in;
+        File file;
+        z_stream stream;
+        std::size_t fed;
+        bool finished;
+        std::vector<char> buffer;
+    };
     
-    return "";
-}
-
-Sequence loadDataWithContentsOFile(const File &file) {
-    std::ifstream in(file.c_str());
-    if (in.is_open()) {
-        // info("Loading file %s...\n", file.c_str());
+    /**
+     bgzip file, a series of independent gzip blocks of at most 64KB each. A
+     batch of blocks is inflated at once on the thread pool, every block into
+     its place in the chunk, given by the uncompressed sizes in the trailers.
+     */
+    class BgzfSource : public FastaSource {
+    public:
+        BgzfSource(MappedFile *f, const File &name) : in(f), file(name), offset(0) {}
         
-        in.seekg (0, in.end);
-        long length = in.tellg();
-        // info("file size = %d\n",length);
+        bool fill(const char *&begin, const char *&end) {
+            struct Block {
+                const unsigned char *data;
+                std::size_t size;       //compressed size, without header and trailer
+                std::size_t start;      //in the chunk
+                u_int32_t length, crc;
+            };
+            
+            std::vector<Block> blocks;
+            std::size_t length = 0;
+            while (offset < in->length && blocks.size() < BGZF_BATCH) {
+                const unsigned char *p = reinterpret_cast<const unsigned char *>(in->data + offset);
+                std::size_t size = 0;
+                if (!bgzf_block_size(p, in->length - offset, size)) corrupt();
+                
+                const std::size_t header = 12 + little_endian_16(p + 10);
+                Block b = { p + header, size - header - 8, length, little_endian_32(p + size - 4), little_endian_32(p + size - 8) };
+                blocks.push_back(b);
+                length += b.length;
+                offset += size;
+            }
+            if (blocks.empty()) return false;
+            
+            buffer.resize(length);
+            std::atomic<bool> failed(false);
+            thread_pool().parallel_for(blocks.size(), [&](const std::size_t k) {
+                const Block &b = blocks[k];
+                Bytef *out = reinterpret_cast<Bytef *>(&buffer[0] + b.start);
+                
+                z_stream stream;
+                memset(&stream, 0, sizeof(stream));
+                inflateInit2(&stream, -15);
+                stream.next_in = const_cast<Bytef *>(b.data);
+                stream.avail_in = static_cast<uInt>(b.size);
+                stream.next_out = out;
+                stream.avail_out = b.length;
+                const int status = inflate(&stream, Z_FINISH);
+                if (status != Z_STREAM_END || stream.avail_out || crc32(crc32(0, Z_NULL, 0), out, b.length) != b.crc)
+                    failed = true;
+                inflateEnd(&stream);
+            });
+            if (failed) corrupt();
+            in->release(in->data + offset);
+            
+            //the last block of a bgzip file is empty
+            if (!length) return fill(begin, end);
+            
+            begin = &buffer[0];
+            end = begin + length;
+            return true;
+        }
         
-        Sequence content;
-        content.resize(length);
-        in.seekg (0, in.beg);
-        in.read(&content[0], content.size());
-        in.close();
-        // info("string length = %d\n",content.length());
-        // info("numer of charaters extracted = %d\n",in.gcount());
+    private:
+        void corrupt() const {
+            std::cerr << "error: " << file << " is not a valid bgzip file" << std::endl;
+            exit(EXIT_FAILURE);
+        }
         
-        // remove fasta header (assumes sequence has header file)
-        std::string::iterator it = std::find(content.begin(), content.end(), '\n');
-        content.erase(content.begin(), it+1);
+        std::unique_ptr<MappedFile> in;
+        File file;
+        std::size_t offset;
+        std::vector<char> buffer;
+    };
+}
+
+#pragma mark - Fasta reader
+FastaReader::FastaReader(const File &file) : source(NULL), twobit(NULL), pos(NULL), end(NULL), line_start(true) {
+    MappedFile *in = new MappedFile(file);
+    if (!in->opened) {
+        delete in;
+        return;
+    }
+    
+    if (twobit_signature(reinterpret_cast<const unsigned char *>(in->data), in->length)) {
+        twobit = new TwoBitReader(in);
+        if (!twobit->is_valid()) {
+            std::cerr << "error: " << file << " is not a valid .2bit file" << std::endl;
+            delete twobit;
+            twobit = NULL;
+        }
+        return;
+    }
+    
+    std::size_t size = 0;
+    if (bgzf_block_size(reinterpret_cast<const unsigned char *>(in->data), in->length, size))
+        source = new BgzfSource(in, file);
+    else if (is_gzip(*in))
+        source = new GzipSource(in, file);
+    else
+        source = new MappedSource(in);
+}
+
+FastaReader::~FastaReader() {
+    delete source;
+    delete twobit;
+}
+
+/**
+ True if there is something left to read at +pos+, reading the next chunk if needed
+ */
+bool FastaReader::fill() {
+    if (pos < end) return true;
+    return source->fill(pos, end);
+}
+
+bool FastaReader::next(Header &header, Sequence &sequence) {
+    if (twobit) return twobit->next(header, sequence);
+    
+    header.clear();
+    sequence.clear();
+    if (!source || !fill()) return false;
+    
+    //header line
+    for (;;) {
+        const char *nl = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        header.append(pos, nl ? nl : end);
+        pos = nl ? nl+1 : end;
+        if (nl || !fill()) break;
+    }
+    if (!header.empty() && header[header.size()-1] == '\r')
+        header.erase(header.size()-1);
+    line_start = true;
+    
+    //sequence lines, up to the next line starting with '>'
+    const char *sized = NULL;
+    while (fill()) {
+        if (line_start && *pos == '>') break;
         
-        // remove newline characters
-        content.erase(std::remove(content.begin(), content.end(), '\n'), content.end());
+        //room for the rest of the record, or the rest of the chunk if it goes on
+        if (sized != end) {
+            sized = end;
+            const char *record_end = NULL;
+            for (const char *gt = pos; gt < end && (gt = static_cast<const char *>(memchr(gt, '>', end - gt))); ++gt) {
+                if ((gt == pos && line_start) || (gt > pos && gt[-1] == '\n')) {
+                    record_end = gt;
+                    break;
+                }
+            }
+            const std::size_t wanted = sequence.size() + ((record_end ? record_end : end) - pos);
+            if (wanted > sequence.capacity())
+                sequence.reserve(record_end ? wanted : std::max(wanted, 2 * sequence.capacity()));
+        }
         
-        // remove invalid characters such as 'N'
-        // content.erase(std::remove(content.begin(), content.end(), 'N'), content.end());
+        const char *nl = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        const char *line_end = nl ? nl : end;
+        sequence.append(pos, (line_end > pos && line_end[-1] == '\r') ? line_end-1 : line_end);
+        pos = nl ? nl+1 : end;
+        line_start = nl != NULL;
+        source->consumed(pos);
+    }
+    
+    return true;
+}
+
+#pragma mark - Records
+void RecordTable::clear() {
+    headers.clear();
+    starts.clear();
+}
+
+void RecordTable::add(const Header &header, const std::size_t start) {
+    headers.push_back(header);
+    starts.push_back(start);
+}
+
+void RecordTable::swap(RecordTable &other) {
+    headers.swap(other.headers);
+    starts.swap(other.starts);
+}
+
+std::size_t RecordTable::find(const std::size_t pos) const {
+    return std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+}
+
+#pragma mark - Loading
+/**
+ True if +file+ is gzip (or bgzip) compressed
+ */
+bool is_compressed(const File &file) {
+    unsigned char magic[2] = {0, 0};
+    FILE *f = fopen(file.c_str(), "rb");
+    if (!f) return false;
+    const bool gzip = fread(magic, 1, 2, f) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    fclose(f);
+    return gzip;
+}
+
+/**
+ True if +file+ is a .2bit file
+ */
+bool is_twobit(const File &file) {
+    unsigned char signature[4] = {0, 0, 0, 0};
+    FILE *f = fopen(file.c_str(), "rb");
+    if (!f) return false;
+    const std::size_t n = fread(signature, 1, 4, f);
+    fclose(f);
+    return twobit_signature(signature, n);
+}
+
+/**
+ Estimated size of the sequence in +file+, a compressed or .2bit file is taken
+ to hold about four times its size
+ */
+std::size_t sequence_size(const File &file) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0) return 0;
+    return (is_compressed(file) || is_twobit(file)) ? 4 * static_cast<std::size_t>(st.st_size) : st.st_size;
+}
+
+/**
+ Every record of +file+ in one sequence, RECORD_SEPARATOR between records
+ */
+Sequence loadDataWithContentsOFile(const File &file, RecordTable &records) {
+    FastaReader in(file);
+    if (!in.is_open()) {
+        info("Check file: %s\n", file.c_str());
+        exit(EXIT_FAILURE);
+    }
+    
+    records.clear();
+    Sequence content, sequence;
+    Header header;
+    while (in.next(header, sequence)) {
+        if (records.size() == 0) {
+            records.add(header, 0);
+            content.swap(sequence);
+            continue;
+        }
         
-        // info("Done loading %s.\n", file.c_str());
-        return content;
-    } else {
+        if (records.size() == 1)
+            content.reserve(std::max(content.size() + sequence.size() + 1, sequence_size(file)));
+        content.push_back(RECORD_SEPARATOR);
+        records.add(header, content.size());
+        content.append(sequence);
+    }
+    return content;
+}
+
+/**
+ Every record of +file+ packed in one sequence, as loadDataWithContentsOFile()
+ would give it. A .2bit file is copied without going through text. The runs of
+ lowercase bases are added to +soft_masked+ when given.
+ */
+void loadPackedContentsOFile(const File &file, RecordTable &records, PackedSequence &sequence, std::vector<MaskBlock> *soft_masked) {
+    records.clear();
+    sequence.clear();
+    
+    if (!is_twobit(file)) {
+        const Sequence text = loadDataWithContentsOFile(file, records);
+        sequence.assign(text);
+        for (std::size_t i = 0; soft_masked && i < text.size(); ++i) {
+            if (!islower(static_cast<u_char>(text[i]))) continue;
+            if (!soft_masked->empty() && soft_masked->back().start + soft_masked->back().length == i) {
+                soft_masked->back().length++;
+            } else {
+                const MaskBlock mask = {i, 1};
+                soft_masked->push_back(mask);
+            }
+        }
+        return;
+    }
+    
+    TwoBitReader in(new MappedFile(file));
+    if (!in.is_valid()) {
         info("Check file: %s\n", file.c_str());
         exit(EXIT_FAILURE);
     }
     
-    return "";
+    Header header;
+    while (in.has_next()) {
+        if (records.size())
+            sequence.append_ambiguous(1);   //RECORD_SEPARATOR
+        const std::size_t start = sequence.size();
+        in.append(header, sequence, soft_masked);
+        records.add(header, start);
+    }
 }
 
-void load_next_batch(std::ifstream &in, std::vector<std::pair<Header, Sequence> > &sequences, const int batch_size) {
+/**
+ Every record of +file+ in one sequence, +header+ is the first line of the file
+ */
+Sequence loadDataWithContentsOFile(const File &file, Header &header) {
+    RecordTable records;
+    Sequence content = loadDataWithContentsOFile(file, records);
+    header = records.size() ? records.header(0) : Header();
+    return content;
+}
+
+Sequence loadDataWithContentsOFile(const File &file) {
+    Header header;
+    return loadDataWithContentsOFile(file, header);
+}
+
+void load_next_batch(FastaReader &in, std::vector<std::pair<Header, Sequence> > &sequences, const int batch_size) {
     int counter = 0;
     std::vector<std::pair<Header, Sequence> > data;
     data.reserve(batch_size);
     
-    std::string line;
-    while (counter < batch_size && in.good()) {
-        std::getline(in, line);
-        const std::string header(line);
-        std::string seq ("");
-        
-        while (in.peek() != '>' && in.good()) {
-            std::getline(in, line);
-            seq.append(line);
-        }
+    Header header;
+    Sequence seq;
+    while (counter < batch_size && in.next(header, seq)) {
         data.push_back(std::make_pair(header, seq));
         counter++;
     }
@@ -111,7 +677,6 @@ Files retrieve_directory_content( const Path &dir_path, const Extension &ext) {
     Path dir = dir_path;
     if (dir.back() != '/') dir.append("/");
     
-    const Extension file_extension = "." + ext;
     Files files;
     files.reserve(50000);
     
@@ -125,7 +690,7 @@ Files retrieve_directory_content( const Path &dir_path, const Extension &ext) {
             int status = lstat(s.c_str(), &st);
             if (status != -1) {
                 //match file extension with what is provided
-                if (S_ISREG(st.st_mode) && (s.substr(s.length()-file_extension.length()) == file_extension)) {
+                if (S_ISREG(st.st_mode) && (has_extension(s, ext) || has_extension(s, ext + ".gz"))) {
                     files.push_back(s);
                     //info("%s\n", s.c_str());
                 }
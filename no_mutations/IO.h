@@ -17,13 +17,171 @@
 #include <unistd.h>
 
 #include "Types.h"
+#include "PackedSequence.h"
 
 
+/**
+ Read-only mapping of a whole file, unmapped from the front as it is read
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const File &file);
+    ~MappedFile();
+    
+    /**
+     Unmaps the whole pages before +consumed+ once there are enough of them
+     */
+    void release(const char *consumed);
+    
+    bool opened;
+    char *data;
+    std::size_t length;
+    
+private:
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+    
+    char *released;     //pages before this are unmapped
+};
+
+/**
+ Run of lowercase (soft-masked) bases
+ */
+struct MaskBlock {
+    u_int64_t start;
+    u_int64_t length;
+};
+
+/**
+ Sequences of a UCSC .2bit file, one record per sequence. The packed bases are
+ unpacked a byte (4 bases) at a time and the mask and N blocks applied over
+ them, so there is no text to parse and a quarter of the bytes to read.
+ append() skips the text altogether and copies the packed bytes into a
+ PackedSequence, remapping their codes a byte at a time.
+ */
+class TwoBitReader {
+public:
+    explicit TwoBitReader(MappedFile *in);
+    ~TwoBitReader();
+    
+    bool is_valid() const { return valid; }
+    bool has_next() const { return current < index.size(); }
+    bool next(Header &header, Sequence &sequence);
+    bool append(Header &header, PackedSequence &sequence, std::vector<MaskBlock> *soft_masked);
+    
+private:
+    TwoBitReader(const TwoBitReader &);
+    TwoBitReader & operator=(const TwoBitReader &);
+    
+    /**
+     Where the next sequence, its blocks and its packed bases start
+     */
+    struct Record {
+        u_int32_t size;
+        u_int32_t number_of_n_blocks, number_of_mask_blocks;
+        std::size_t n_blocks, mask_blocks, packed;
+    };
+    bool next_record(Header &header, Record &record);
+    void block(const std::size_t blocks, const u_int32_t count, const u_int32_t b, const u_int32_t size, std::size_t &first, std::size_t &length) const;
+    
+    u_int32_t read32(std::size_t &pos) const;
+    u_int64_t read64(std::size_t &pos) const;
+    
+    MappedFile *in;
+    bool swapped;       //written on a machine of the other byte order
+    bool valid;
+    std::vector<std::pair<Header, u_int64_t> > index;   //name and offset of every sequence
+    std::size_t current;
+};
+
+/**
+ Bytes of a fasta file in order, in one or more chunks
+ */
+class FastaSource {
+public:
+    virtual ~FastaSource() {}
+    
+    /**
+     Next chunk, valid until the following call. False at the end of the file.
+     */
+    virtual bool fill(const char *&begin, const char *&end) = 0;
+    
+    /**
+     Everything before +upto+ in the current chunk has been read
+     */
+    virtual void consumed(const char * /*upto*/) {}
+};
+
+/**
+ Reads the records of a fasta file one at a time. Plain files are read through
+ a read-only mapping, gzip files are inflated as they are read and bgzip (BGZF)
+ files are inflated a batch of blocks at a time on the thread pool. Every
+ record is copied once, line by line, into its sequence without the line
+ breaks (\n or \r\n). A .2bit file is read by a TwoBitReader instead.
+ */
+class FastaReader {
+public:
+    explicit FastaReader(const File &file);
+    ~FastaReader();
+    
+    bool is_open() const { return source != NULL || twobit != NULL; }
+    
+    /**
+     The next record, +header+ is its first line (with the '>'). False once
+     every record has been read.
+     */
+    bool next(Header &header, Sequence &sequence);
+    
+private:
+    FastaReader(const FastaReader &);
+    FastaReader & operator=(const FastaReader &);
+    
+    bool fill();
+    
+    FastaSource *source;
+    TwoBitReader *twobit;
+    const char *pos, *end;
+    bool line_start;
+};
+
+#define RECORD_SEPARATOR 'N'
+
+/**
+ Records of a fasta file loaded as one sequence. Consecutive records are
+ separated by a single RECORD_SEPARATOR, so no word or extension spans two of
+ them, and positions are translated back to (record, offset) for output.
+ */
+class RecordTable {
+public:
+    void clear();
+    void add(const Header &header, const std::size_t start);
+    void swap(RecordTable &other);
+    
+    std::size_t size() const { return headers.size(); }
+    const Header & header(const std::size_t i) const { return headers[i]; }
+    std::size_t start(const std::size_t i) const { return starts[i]; }
+    
+    /**
+     Record that contains position +pos+ of the sequence
+     */
+    std::size_t find(const std::size_t pos) const;
+    
+private:
+    std::vector<Header> headers;
+    std::vector<std::size_t> starts;
+};
+
 Files retrieve_directory_content( const Path &, const Extension &);
 
+bool is_compressed(const File &);
+bool is_twobit(const File &);
+std::size_t sequence_size(const File &);
+
 Sequence loadDataWithContentsOFile(const File&);
 Sequence loadDataWithContentsOFile(const File &file, Header &header);
-void load_next_batch(std::ifstream &, std::vector<std::pair<Header, Sequence> > &, const int batch_size=1000);
+Sequence loadDataWithContentsOFile(const File &file, RecordTable &records);
+void loadPackedContentsOFile(const File &file, RecordTable &records, PackedSequence &sequence, std::vector<MaskBlock> *soft_masked=NULL);
+void load_next_batch(FastaReader &, std::vector<std::pair<Header, Sequence> > &, const int batch_size=1000);
 
 void print_string_stdout(const char *s);
 void info(const char *fmt,...);
@@ -0,0 +1,420 @@
+//
+//  IndexFile.cpp
+//
+
+#include "IndexFile.h"
+
+#include <sstream>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "IO.h"
+#include "Util.h"
+
+static_assert(sizeof(std::size_t) == sizeof(u_int64_t), "lookup table offsets are stored as 64-bit values");
+
+#pragma mark - Utility functions
+/**
+ FNV-1a taken 8 bytes at a time, with a shift so that the high bits of a word
+ reach the low bits of the hash
+ */
+static u_int64_t fnv1a(const char *data, const std::size_t length, u_int64_t hash=0xcbf29ce484222325ULL) {
+    std::size_t i = 0;
+    for (; i+8 <= length; i += 8) {
+        u_int64_t word;
+        memcpy(&word, data+i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; ++i) {
+        hash ^= static_cast<u_char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ Checksum of the +length+ bytes of an index file at +data+, its header's
+ checksum read as 0
+ */
+static u_int64_t file_checksum(const char *data, const std::size_t length) {
+    IndexFileHeader h;
+    memcpy(&h, data, sizeof(h));
+    h.checksum = 0;
+    return fnv1a(data + sizeof(h), length - sizeof(h), fnv1a(reinterpret_cast<const char *>(&h), sizeof(h)));
+}
+
+static u_int64_t align(const u_int64_t offset) {
+    return (offset + 7) & ~static_cast<u_int64_t>(7);
+}
+
+static void pad(std::ofstream &out, const u_int64_t offset) {
+    static const char zeros[8] = {0};
+    const u_int64_t aligned = align(offset);
+    out.write(zeros, aligned-offset);
+}
+
+/**
+ Checksum of the records and bases of a target, as loaded from any of the
+ formats it can be read from, and of its +soft_masked+ runs if given.
+ Ambiguous bases count as N whatever they are stored as.
+ */
+static u_int64_t source_checksum(const RecordTable &records, const PackedSequence &sequence, const std::vector<MaskBlock> *soft_masked) {
+    u_int64_t hash = fnv1a(NULL, 0);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const u_int64_t start = records.start(i);
+        hash = fnv1a(records.header(i).data(), records.header(i).size(), hash);
+        hash = fnv1a(reinterpret_cast<const char *>(&start), sizeof(start), hash);
+    }
+    
+    const std::size_t size = sequence.size();
+    for (std::size_t k = 0; k < size; k += 32) {
+        const std::size_t n = std::min<std::size_t>(32, size-k);
+        const u_int32_t ambiguous = sequence.ambiguous(k) & static_cast<u_int32_t>((static_cast<u_int64_t>(1) << n) - 1);
+        const u_int64_t words[2] = {sequence.bases(k) & (n < 32 ? (static_cast<u_int64_t>(1) << 2*n) - 1 : ~static_cast<u_int64_t>(0)) & ~(3*spread_bits(ambiguous)), ambiguous};
+        hash = fnv1a(reinterpret_cast<const char *>(words), sizeof(words), hash);
+    }
+    
+    if (soft_masked)
+        hash = fnv1a(reinterpret_cast<const char *>(soft_masked->data()), soft_masked->size()*sizeof(MaskBlock), hash);
+    return hash;
+}
+
+static u_char pack(const char c) {
+    switch (c) {
+        case 'C':   case 'c':   return BA_ENCODED_C;
+        case 'G':   case 'g':   return BA_ENCODED_G;
+        case 'T':   case 't':   return BA_ENCODED_T;
+        default:                return BA_ENCODED_A;
+    }
+}
+
+static bool isACGT(const char c) {
+    switch (c) {
+        case 'A':   case 'C':   case 'G':   case 'T':
+        case 'a':   case 'c':   case 'g':   case 't':
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ True if +count+ items of +size+ bytes from +offset+ lie inside a file of
+ +length+ bytes, after its header, with +offset+ a multiple of +alignment+
+ */
+static bool inside(const u_int64_t offset, const u_int64_t count, const u_int64_t size, const u_int64_t alignment, const std::size_t length) {
+    return offset >= sizeof(IndexFileHeader) && offset <= length && offset % alignment == 0 && count <= (length - offset)/size;
+}
+
+/**
+ The options of +h+ that leave anchors out of the table, as given on the command line
+ */
+static std::string table_options(const IndexFileHeader &h) {
+    std::ostringstream out;
+    if (h.max_occurrences)
+        out << " --max-occurrences=" << h.max_occurrences;
+    if (h.exclude_soft_masked)
+        out << " --exclude-soft-masked";
+    if (h.dust > 0)
+        out << " --dust=" << h.dust;
+    return out.str().empty() ? "none" : out.str().substr(1);
+}
+
+#pragma mark - Writing
+/**
+ Writes +sequence+ packed 4 bases per byte, the runs of non-ACGT letters that
+ read back as N, and the lookup table built from it with the anchors it capped.
+ Case is not kept: the search compares bases ignoring it, and
+ --exclude-soft-masked has already left the lowercase words out of the table.
+ The checksum is filled in once the rest of the file is written.
+ */
+bool IndexFile::write(const File &path, const File &source, const RecordTable &records, const Sequence &sequence, const LookupTable &table) {
+    const std::size_t size = sequence.size();
+
+    Header headers;
+    std::vector<u_int64_t> starts(records.size());
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        headers.append(records.header(i)).push_back('\n');
+        starts[i] = records.start(i);
+    }
+
+    std::string packed((size+3)/4, 0);
+    std::vector<NBlock> n_blocks;
+    for (std::size_t i = 0; i < size; ++i) {
+        const char c = sequence[i];
+        packed[i/4] |= pack(c) << (2*(3-i%4));
+
+        if (!isACGT(c)) {
+            if (!n_blocks.empty() && n_blocks.back().symbol == static_cast<u_char>(c) && n_blocks.back().start+n_blocks.back().length == i && n_blocks.back().length < UINT32_MAX) {
+                n_blocks.back().length++;
+            } else {
+                NBlock block = {i, 1, static_cast<u_char>(c)};
+                n_blocks.push_back(block);
+            }
+        }
+    }
+
+    //the buckets of the words present and their words, unless a direct table
+    //takes less room with a bucket per possible word
+    std::vector<std::size_t> every_word;
+    if (!LOOKUP_SPARSE && table.offsets_data() && table.keys()*(sizeof(Hash) + sizeof(std::size_t)) > LOOKUP_WORDS*sizeof(std::size_t))
+        table.every_word_offsets(every_word);
+    const std::size_t *offsets = every_word.empty() ? table.offsets_data() : every_word.data();
+    const Hash *keys = every_word.empty() ? table.keys_data() : NULL;
+
+    IndexFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_FILE_MAGIC, sizeof(h.magic));
+    h.version = INDEX_FILE_VERSION;
+    h.wordsize = WORDSIZE;
+    h.seqlength = SEQLENGTH;
+    h.entries_per_anchor = LOOKUP_ENTRIES_PER_ANCHOR;
+    h.element_size = sizeof(Element);
+    h.sparse = LOOKUP_SPARSE;
+    h.listed = keys != NULL;
+    h.exclude_soft_masked = options.exclude_soft_masked;
+    h.max_occurrences = options.max_occurrences;
+    h.dust = options.dust;
+
+    //keep an absolute path so the source can be checked from any working directory
+    char resolved[PATH_MAX];
+    const File source_path = realpath(source.c_str(), resolved) ? File(resolved) : source;
+    
+    struct stat st;
+    if (stat(source_path.c_str(), &st) == 0) {
+        h.source_size = st.st_size;
+        h.source_mtime = st.st_mtime;
+    }
+    
+    //the soft-masked runs only matter to the table with --exclude-soft-masked
+    std::vector<MaskBlock> soft_masked;
+    for (std::size_t i = 0; options.exclude_soft_masked && i < size; ++i) {
+        if (!islower(static_cast<u_char>(sequence[i]))) continue;
+        if (!soft_masked.empty() && soft_masked.back().start + soft_masked.back().length == i) {
+            soft_masked.back().length++;
+        } else {
+            const MaskBlock mask = {i, 1};
+            soft_masked.push_back(mask);
+        }
+    }
+    h.source_checksum = source_checksum(records, PackedSequence(sequence), options.exclude_soft_masked ? &soft_masked : NULL);
+
+    h.sequence_length = size;
+    h.number_of_n_blocks = n_blocks.size();
+    h.number_of_keys = !offsets ? 0 : (keys ? table.keys() : LOOKUP_WORDS);
+    h.number_of_elements = table.size();
+    h.number_of_records = records.size();
+    h.number_of_capped = table.capped_size();
+
+    h.header_offset = align(sizeof(h));
+    h.header_length = headers.size();
+    h.records_offset = align(h.header_offset + h.header_length);
+    h.source_offset = align(h.records_offset + h.number_of_records*sizeof(u_int64_t));
+    h.source_length = source_path.size();
+    h.sequence_offset = align(h.source_offset + h.source_length);
+    h.n_blocks_offset = align(h.sequence_offset + packed.size());
+    h.offsets_offset = h.n_blocks_offset + n_blocks.size()*sizeof(NBlock);
+    h.keys_offset = h.offsets_offset + (h.number_of_keys+1)*sizeof(std::size_t);
+    h.elements_offset = align(h.keys_offset + (keys ? h.number_of_keys*sizeof(Hash) : 0));
+    h.capped_offset = h.elements_offset + h.number_of_elements*sizeof(Element);
+    h.presence_offset = h.capped_offset + h.number_of_capped*sizeof(CappedAnchor);
+    h.file_size = h.presence_offset + table.presence_size()*sizeof(u_int64_t);
+
+    std::ofstream out (path.c_str(), std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "error: unable to create index file " << path << std::endl;
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    pad(out, sizeof(h));
+    out.write(headers.data(), headers.size());
+    pad(out, h.header_offset + h.header_length);
+    out.write(reinterpret_cast<const char *>(starts.data()), starts.size()*sizeof(u_int64_t));
+    out.write(source_path.data(), source_path.size());
+    pad(out, h.source_offset + h.source_length);
+    out.write(packed.data(), packed.size());
+    pad(out, h.sequence_offset + packed.size());
+    out.write(reinterpret_cast<const char *>(n_blocks.data()), n_blocks.size()*sizeof(NBlock));
+    if (offsets) {
+        out.write(reinterpret_cast<const char *>(offsets), (h.number_of_keys+1)*sizeof(std::size_t));
+        if (keys) {
+            out.write(reinterpret_cast<const char *>(keys), h.number_of_keys*sizeof(Hash));
+            pad(out, h.keys_offset + h.number_of_keys*sizeof(Hash));
+        }
+        out.write(reinterpret_cast<const char *>(table.elements_data()), table.size()*sizeof(Element));
+    }
+    out.write(reinterpret_cast<const char *>(table.capped_data()), table.capped_size()*sizeof(CappedAnchor));
+    out.write(reinterpret_cast<const char *>(table.presence_data()), table.presence_size()*sizeof(u_int64_t));
+    out.close();
+    if (out.fail()) {
+        std::cerr << "error: unable to write index file " << path << std::endl;
+        return false;
+    }
+
+    //the checksum of what was written, read back through a mapping of the file
+    const int fd = ::open(path.c_str(), O_RDWR);
+    void *addr = fd < 0 ? MAP_FAILED : mmap(NULL, h.file_size, PROT_READ, MAP_SHARED, fd, 0);
+    bool written = addr != MAP_FAILED;
+    if (written) {
+        const u_int64_t checksum = file_checksum(static_cast<const char *>(addr), h.file_size);
+        munmap(addr, h.file_size);
+        written = pwrite(fd, &checksum, sizeof(checksum), offsetof(IndexFileHeader, checksum)) == sizeof(checksum);
+    }
+    if (fd >= 0)
+        ::close(fd);
+    if (!written)
+        std::cerr << "error: unable to write the checksum of index file " << path << std::endl;
+    return written;
+}
+
+#pragma mark - Reading
+/**
+ True if +source+ still holds the records and bases the index of header +h+
+ was built from. Its size and modification time are not enough, an edit can
+ keep both (touch -r, copied trees, coarse timestamps).
+ */
+static bool same_source(const File &source, const IndexFileHeader &h) {
+    RecordTable records;
+    PackedSequence sequence;
+    std::vector<MaskBlock> soft_masked;
+    loadPackedContentsOFile(source, records, sequence, h.exclude_soft_masked ? &soft_masked : NULL);
+    return source_checksum(records, sequence, h.exclude_soft_masked ? &soft_masked : NULL) == h.source_checksum;
+}
+
+IndexFile::IndexFile() : data(NULL), length(0), header(NULL) {}
+
+IndexFile::~IndexFile() {
+    close();
+}
+
+void IndexFile::close() {
+    if (data)
+        munmap(const_cast<char *>(data), length);
+    data = NULL;
+    length = 0;
+    header = NULL;
+}
+
+/**
+ Maps +path+ read-only and rejects files that were written by a different
+ version, for a different WORDSIZE/SEQLENGTH, with other options that leave
+ anchors out of the table than this run's, or from a fasta file that has
+ changed since, which is read again to compare its contents. So is a file
+ whose header points outside of it or whose checksum does not match, before
+ any of it is read.
+ */
+bool IndexFile::open(const File &p) {
+    close();
+    path = p;
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "error: unable to open index file " << path << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(IndexFileHeader)) {
+        std::cerr << "error: " << path << " is not a limes index file" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "error: unable to map index file " << path << std::endl;
+        return false;
+    }
+    data = static_cast<const char *>(addr);
+    length = st.st_size;
+    header = reinterpret_cast<const IndexFileHeader *>(data);
+
+    const IndexFileHeader &h = *header;
+    std::string reason;
+    if (memcmp(h.magic, INDEX_FILE_MAGIC, sizeof(h.magic)) != 0)
+        reason = "not a limes index file";
+    else if (h.version != INDEX_FILE_VERSION)
+        reason = "index file version mismatch";
+    else if (h.wordsize != WORDSIZE || h.seqlength != SEQLENGTH)
+        reason = "index was built with a different WORDSIZE/SEQLENGTH";
+    else if (h.entries_per_anchor != LOOKUP_ENTRIES_PER_ANCHOR || h.element_size != sizeof(Element) || h.sparse != LOOKUP_SPARSE)
+        reason = "index was built by a different Limes variant";
+    else if (h.file_size != length)
+        reason = "index file is truncated";
+    else if (h.max_occurrences != options.max_occurrences || (h.exclude_soft_masked != 0) != options.exclude_soft_masked || h.dust != options.dust)
+        reason = "index was built with options " + table_options(h) + ", search with the same ones or rebuild it";
+    else if (!inside(h.header_offset, h.header_length, 1, 1, length) || !inside(h.records_offset, h.number_of_records, sizeof(u_int64_t), 8, length)
+             || !inside(h.source_offset, h.source_length, 1, 1, length) || !inside(h.sequence_offset, h.sequence_length/4 + (h.sequence_length%4 != 0), 1, 8, length)
+             || !inside(h.n_blocks_offset, h.number_of_n_blocks, sizeof(NBlock), 8, length) || h.number_of_keys >= length || !inside(h.offsets_offset, h.number_of_keys+1, sizeof(std::size_t), 8, length)
+             || !inside(h.keys_offset, h.listed ? h.number_of_keys : 0, sizeof(Hash), sizeof(Hash), length) || !inside(h.elements_offset, h.number_of_elements, sizeof(Element), 8, length)
+             || !inside(h.capped_offset, h.number_of_capped, sizeof(CappedAnchor), 8, length) || !inside(h.presence_offset, 0, 1, 8, length)
+             || (h.presence_offset < length && length - h.presence_offset != LookupTable::presence_words(h.number_of_elements + h.number_of_capped)*sizeof(u_int64_t)))
+        reason = "index file is corrupt, its header points outside of it";
+    else if (file_checksum(data, length) != h.checksum)
+        reason = "checksum mismatch, index file is corrupt";
+
+    if (reason.empty() && h.source_length) {
+        const File source(data + h.source_offset, h.source_length);
+        const bool found = stat(source.c_str(), &st) == 0;
+        if (found && (static_cast<u_int64_t>(st.st_size) != h.source_size || st.st_mtime != h.source_mtime || !same_source(source, h)))
+            reason = "index is stale, " + source + " has changed since it was indexed";
+    }
+
+    if (!reason.empty()) {
+        std::cerr << "error: " << path << ": " << reason << std::endl;
+        close();
+        return false;
+    }
+
+    madvise(const_cast<char *>(data) + h.offsets_offset, length - h.offsets_offset, MADV_RANDOM);
+    return true;
+}
+
+/**
+ Reads the packed target sequence and points +table+ at the mapped buckets, the
+ table is only valid for as long as this file stays open
+ */
+bool IndexFile::load(RecordTable &records, PackedSequence &sequence, LookupTable &table) const {
+    if (!header) return false;
+    const IndexFileHeader &h = *header;
+
+    const char *packed = data + h.sequence_offset;
+    const NBlock *n_blocks = reinterpret_cast<const NBlock *>(data + h.n_blocks_offset);
+
+    sequence.assign_packed(packed, h.sequence_length);
+    for (u_int64_t i = 0; i < h.number_of_n_blocks; ++i)
+        sequence.set_ambiguous(n_blocks[i].start, n_blocks[i].length);
+
+    records.clear();
+    const u_int64_t *starts = reinterpret_cast<const u_int64_t *>(data + h.records_offset);
+    const char *line = data + h.header_offset;
+    for (u_int64_t i = 0; i < h.number_of_records; ++i) {
+        const char *nl = static_cast<const char *>(memchr(line, '\n', data + h.header_offset + h.header_length - line));
+        if (!nl) {
+            std::cerr << "error: " << path << ": index file has fewer record headers than records" << std::endl;
+            return false;
+        }
+        records.add(Header(line, nl), starts[i]);
+        line = nl + 1;
+    }
+
+    const std::size_t *offsets = reinterpret_cast<const std::size_t *>(data + h.offsets_offset);
+    const Hash *keys = h.listed ? reinterpret_cast<const Hash *>(data + h.keys_offset) : NULL;
+    const Element *elements = reinterpret_cast<const Element *>(data + h.elements_offset);
+    const CappedAnchor *capped = reinterpret_cast<const CappedAnchor *>(data + h.capped_offset);
+    const u_int64_t *presence = h.presence_offset < h.file_size ? reinterpret_cast<const u_int64_t *>(data + h.presence_offset) : NULL;
+    table.attach(offsets, keys, elements, h.number_of_keys, h.number_of_elements, capped, h.number_of_capped, presence);
+
+    return true;
+}
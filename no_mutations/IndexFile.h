@@ -0,0 +1,100 @@
+//
+//  IndexFile.h
+//
+
+#ifndef IndexFile_hpp
+#define IndexFile_hpp
+
+#include <iostream>
+#include <fstream>
+#include <sys/types.h>
+
+#include "Types.h"
+#include "IO.h"
+#include "PackedSequence.h"
+#include "LookupTable.h"
+
+#define INDEX_FILE_MAGIC "LIMESIDX"
+#define INDEX_FILE_VERSION 11
+#define INDEX_FILE_EXTENSION "lidx"
+
+/**
+ Fixed size header at the start of every index file, all offsets are in bytes
+ from the beginning of the file and aligned to 8 bytes
+ */
+struct IndexFileHeader {
+    char magic[8];
+    u_int32_t version;
+    u_int32_t wordsize;
+    u_int32_t seqlength;
+    u_int32_t entries_per_anchor;
+    u_int32_t element_size;
+    u_int32_t sparse;               //1 if the table has no headers and hashes its presence bitmaps
+    u_int32_t listed;               //1 if only the words present have a bucket and their words are kept, always for a sparse table
+
+    u_int32_t exclude_soft_masked;  //options the table was built with, a search must give the same
+    u_int64_t max_occurrences;
+    double dust;
+
+    u_int64_t source_size;          //size and modification time of the fasta file the index was built from
+    int64_t source_mtime;
+    u_int64_t source_checksum;      //of its records and bases, and soft-masked runs with --exclude-soft-masked
+    u_int64_t checksum;             //over the whole file, this field read as 0
+
+    u_int64_t sequence_length;
+    u_int64_t number_of_n_blocks;
+    u_int64_t number_of_keys;
+    u_int64_t number_of_elements;
+    u_int64_t number_of_records;
+    u_int64_t number_of_capped;             //anchors left out of the table by --max-occurrences
+
+    u_int64_t header_offset, header_length;     //record headers, one per line
+    u_int64_t records_offset;                   //record starts in the sequence
+    u_int64_t source_offset, source_length;
+    u_int64_t sequence_offset;
+    u_int64_t n_blocks_offset;
+    u_int64_t offsets_offset;
+    u_int64_t keys_offset;                  //words of the buckets if listed, ascending
+    u_int64_t elements_offset;
+    u_int64_t capped_offset;
+    u_int64_t presence_offset;              //bitmaps of the begin and end words in the table
+    u_int64_t file_size;
+};
+
+/**
+ Run of a non-ACGT symbol (N, IUPAC codes), stored as A in the packed sequence
+ */
+struct NBlock {
+    u_int64_t start;
+    u_int32_t length;
+    u_int32_t symbol;
+};
+
+/**
+ Target sequence (2 bits per base) and its lookup table persisted to disk, so
+ targets that do not change between runs are mapped instead of rebuilt. open()
+ checks that every region the header points at lies inside the file and that
+ the checksum of the whole file matches before any of it is used.
+ */
+class IndexFile {
+public:
+    IndexFile();
+    ~IndexFile();
+
+    static bool write(const File &path, const File &source, const RecordTable &records, const Sequence &sequence, const LookupTable &table);
+
+    bool open(const File &path);
+    void close();
+    bool load(RecordTable &records, PackedSequence &sequence, LookupTable &table) const;
+
+private:
+    IndexFile(const IndexFile &);
+    IndexFile & operator=(const IndexFile &);
+
+    File path;
+    const char *data;
+    std::size_t length;
+    const IndexFileHeader *header;
+};
+
+#endif /* IndexFile_hpp */
@@ -0,0 +1,458 @@
+//
+//  LookupTable.cpp
+//
+
+#include "LookupTable.h"
+#include "ThreadPool.h"
+#include "Util.h"
+
+#include <algorithm>
+
+//keys per block of the sliced prefix sum and of the parallel bucket sort
+#define LOOKUP_KEY_BLOCK 65536
+
+LookupTable::LookupTable() : bucket_offsets(NULL), bucket_keys(NULL), bucket_elements(NULL), capped_anchors(NULL), presence_bits(NULL), number_of_keys(0), number_of_elements(0), number_of_capped(0), presence_slots(0), number_of_slices(1), generation(0), cursors(false) {}
+
+std::size_t LookupTable::slices(const std::size_t anchors) {
+    //a slice counts into 32 bits
+    if (LOOKUP_SPARSE || !options.sliced_build || anchors > 0xFFFFFFFFULL) return 1;
+    
+    const std::size_t fit = anchors*sizeof(Element) / (LOOKUP_WORDS*sizeof(u_int32_t));
+    return std::max<std::size_t>(1, std::min<std::size_t>(thread_pool().size(), fit));
+}
+
+/**
+ Empties the table for the next build. A direct table keeps its storage and
+ starts a new generation of headers, or zeroes one counter per word and slice
+ for a table built from several +slices+. A sparse table collects the counted
+ keys instead.
+ */
+void LookupTable::clear(const std::size_t slices) {
+    forget();
+    number_of_slices = LOOKUP_SPARSE ? 1 : std::max<std::size_t>(1, slices);
+    cursors = false;
+    if (!LOOKUP_SPARSE) {
+        next_generation();
+        if (number_of_slices > 1)
+            histograms.assign(number_of_slices*LOOKUP_WORDS, 0);
+    }
+    offsets.clear();
+    keys_list.clear();
+    directory.clear();
+    elements.clear();
+    capped_list.clear();
+    if (LOOKUP_SPARSE)
+        presence.clear();
+    
+    bucket_offsets = NULL;
+    bucket_keys = NULL;
+    bucket_elements = NULL;
+    capped_anchors = NULL;
+    presence_bits = NULL;
+    number_of_keys = number_of_elements = number_of_capped = presence_slots = 0;
+}
+
+/**
+ Sizes the headers of a direct table and starts a new generation of them, the
+ headers of an earlier generation read as empty. They are only zeroed when the
+ generation wraps around.
+ */
+void LookupTable::next_generation() {
+    if (headers.size() != LOOKUP_WORDS || ++generation == 0) {
+        headers.assign(LOOKUP_WORDS, BucketHeader());
+        generation = 1;
+    }
+}
+
+/**
+ Unsets the presence bits of the last build of a direct table, by zeroing the
+ words of the bitmaps that its begin words, end words and capped anchors fall in
+ */
+void LookupTable::forget() {
+    if (LOOKUP_SPARSE || presence.empty() || presence_bits != presence.data()) return;
+    
+    for (std::size_t k = 0; k < keys_list.size(); ++k)
+        presence[static_cast<std::size_t>(keys_list[k]) >> 6] = 0;
+    for (std::size_t i = 0; i < elements.size(); ++i)
+        presence[(presence_slots + static_cast<std::size_t>(elements[i].id())) >> 6] = 0;
+    for (std::size_t i = 0; i < capped_list.size(); ++i) {
+        presence[static_cast<std::size_t>(capped_list[i].begin) >> 6] = 0;
+        presence[(presence_slots + static_cast<std::size_t>(capped_list[i].end)) >> 6] = 0;
+    }
+}
+
+/**
+ Sizes +v+ for +n+ items, growing its storage geometrically so that a run of
+ slightly larger targets does not reallocate for each of them
+ */
+template <class T> static void grow(std::vector<T> &v, const std::size_t n) {
+    if (n > v.capacity())
+        v.reserve(std::max(n, v.capacity() + v.capacity()/2));
+    v.resize(n);
+}
+
+/**
+ Frees the buckets, the table is empty until it is built or attached again
+ */
+void LookupTable::release() {
+    std::vector<std::size_t>().swap(offsets);
+    std::vector<Hash>().swap(keys_list);
+    std::vector<std::size_t>().swap(directory);
+    std::vector<BucketHeader>().swap(headers);
+    std::vector<u_int32_t>().swap(histograms);
+    Elements().swap(elements);
+    std::vector<CappedAnchor>().swap(capped_list);
+    std::vector<u_int64_t>().swap(presence);
+    
+    bucket_offsets = NULL;
+    bucket_keys = NULL;
+    bucket_elements = NULL;
+    capped_anchors = NULL;
+    presence_bits = NULL;
+    number_of_keys = number_of_elements = number_of_capped = presence_slots = 0;
+    number_of_slices = 1;
+    cursors = false;
+}
+
+/**
+ Sliced prepare(): the words counted by any slice become the buckets, and the
+ histogram of slice s for a word the slot of the first element that slice
+ inserts in its bucket, after the elements of the slices before it. Blocks of
+ words are counted in parallel, then placed after the blocks before them.
+ */
+void LookupTable::prepare_slices() {
+    const std::size_t blocks = (LOOKUP_WORDS + LOOKUP_KEY_BLOCK - 1)/LOOKUP_KEY_BLOCK;
+    std::vector<std::size_t> block_keys(blocks+1, 0), block_sums(blocks+1, 0);
+    
+    ThreadPool &pool = thread_pool();
+    pool.parallel_for(blocks, [&](const std::size_t b){
+        std::size_t keys = 0, sum = 0;
+        for (std::size_t w = b*LOOKUP_KEY_BLOCK; w < std::min(LOOKUP_WORDS, (b+1)*LOOKUP_KEY_BLOCK); ++w) {
+            std::size_t count = 0;
+            for (std::size_t s = 0; s < number_of_slices; ++s)
+                count += histograms[s*LOOKUP_WORDS + w];
+            keys += count > 0;
+            sum += count;
+        }
+        block_keys[b+1] = keys;
+        block_sums[b+1] = sum;
+    });
+    for (std::size_t b = 0; b < blocks; ++b) {
+        block_keys[b+1] += block_keys[b];
+        block_sums[b+1] += block_sums[b];
+    }
+    keys_list.resize(block_keys[blocks]);
+    offsets.resize(block_keys[blocks]+1);
+    
+    //fewer than 2^32 elements in all, see slices()
+    pool.parallel_for(blocks, [&](const std::size_t b){
+        std::size_t k = block_keys[b];
+        u_int32_t slot = static_cast<u_int32_t>(block_sums[b]);
+        for (std::size_t w = b*LOOKUP_KEY_BLOCK; w < std::min(LOOKUP_WORDS, (b+1)*LOOKUP_KEY_BLOCK); ++w) {
+            const u_int32_t first = slot;
+            for (std::size_t s = 0; s < number_of_slices; ++s) {
+                const u_int32_t count = histograms[s*LOOKUP_WORDS + w];
+                histograms[s*LOOKUP_WORDS + w] = slot;
+                slot += count;
+            }
+            if (slot != first) {
+                headers[w].generation = generation;
+                headers[w].slot = static_cast<u_int32_t>(k);
+                keys_list[k] = static_cast<Hash>(w);
+                offsets[k++] = first;
+            }
+        }
+    });
+    offsets.back() = block_sums[blocks];
+    bucket_keys = keys_list.data();
+    number_of_keys = keys_list.size();
+    grow(elements, block_sums[blocks]);
+}
+
+/**
+ Exclusive prefix sum over the counts, offsets[k] becomes the first slot of bucket k.
+ The buckets are first put in the order of their words: a sparse table turns
+ the counted keys into one bucket per distinct key, a direct table sorts the
+ words it counted and points their headers at their buckets.
+ */
+void LookupTable::prepare() {
+    if (number_of_slices > 1) {
+        prepare_slices();
+        return;
+    }
+    if (LOOKUP_SPARSE) {
+        std::sort(keys_list.begin(), keys_list.end());
+        offsets.clear();
+        std::size_t distinct = 0;
+        for (std::size_t i = 0; i < keys_list.size(); ) {
+            std::size_t j = i+1;
+            while (j < keys_list.size() && keys_list[j] == keys_list[i]) ++j;
+            keys_list[distinct++] = keys_list[i];
+            offsets.push_back(j-i);
+            i = j;
+        }
+        keys_list.resize(distinct);
+        std::vector<Hash>(keys_list).swap(keys_list);
+        offsets.push_back(0);
+        
+        bucket_keys = keys_list.data();
+        number_of_keys = distinct;
+        index_keys();
+    } else {
+        //a large target has most words present, reading them off the headers in order beats sorting them
+        if (keys_list.size() >= LOOKUP_LISTED_WORDS) {
+            keys_list.clear();
+            for (std::size_t w = 0; w < LOOKUP_WORDS; ++w)
+                if (headers[w].generation == generation)
+                    keys_list.push_back(static_cast<Hash>(w));
+        } else
+            std::sort(keys_list.begin(), keys_list.end());
+        offsets.resize(keys_list.size()+1);
+        for (std::size_t k = 0; k < keys_list.size(); ++k)
+            offsets[k] = headers[keys_list[k]].slot;
+        offsets.back() = 0;
+        
+        bucket_keys = keys_list.data();
+        number_of_keys = keys_list.size();
+    }
+    
+    std::size_t sum = 0;
+    for (std::vector<std::size_t>::size_type k = 0; k < offsets.size(); ++k) {
+        const std::size_t count = offsets[k];
+        offsets[k] = sum;
+        sum += count;
+    }
+    grow(elements, sum);
+    
+    //insert() then writes through the header of its word alone, or through the
+    //bucket's place among the words present when the slots do not fit
+    if (!LOOKUP_SPARSE) {
+        cursors = sum <= 0xFFFFFFFFULL;
+        for (std::size_t k = 0; k < number_of_keys; ++k)
+            headers[keys_list[k]].slot = static_cast<u_int32_t>(cursors ? offsets[k] : k);
+    }
+}
+
+/**
+ insert() leaves offsets[k] pointing one past the last element of bucket k,
+ shift everything one slot to the right to get the bucket boundaries back
+ */
+void LookupTable::seal() {
+    if (offsets.empty()) return;
+    if (number_of_slices > 1) {
+        //the offsets are still the bucket starts
+        std::vector<u_int32_t>().swap(histograms);
+        number_of_slices = 1;
+    } else if (cursors) {
+        //the offsets are still the bucket starts, the headers point to the buckets again
+        for (std::size_t k = 0; k+1 < offsets.size(); ++k)
+            headers[keys_list[k]].slot = static_cast<u_int32_t>(k);
+        cursors = false;
+    } else {
+        for (std::vector<std::size_t>::size_type k = offsets.size()-1; k > 0; --k)
+            offsets[k] = offsets[k-1];
+        offsets[0] = 0;
+    }
+    
+    bucket_offsets = offsets.data();
+    bucket_keys = keys_list.data();
+    bucket_elements = elements.data();
+    number_of_keys = offsets.size()-1;
+    number_of_elements = elements.size();
+    mark_present();
+}
+
+/**
+ Bits in either presence bitmap: one per possible word, or for a sparse table
+ the power of two at or above four times its number of anchors
+ */
+static std::size_t number_of_presence_slots(const std::size_t anchors) {
+    if (!LOOKUP_SPARSE) return LOOKUP_WORDS;
+    std::size_t slots = 64;
+    while (slots < 4*anchors) slots <<= 1;
+    return slots;
+}
+
+/**
+ 64-bit words of the presence bitmaps of a table of +anchors+, capped ones included
+ */
+std::size_t LookupTable::presence_words(const std::size_t anchors) {
+    return (2*number_of_presence_slots(anchors) + 63)/64;
+}
+
+/**
+ Sets the bits of the begin and end words of every element and capped anchor.
+ The bitmaps of a direct table are only zeroed once, forget() unsets the bits of
+ one build before the next; cap() moves anchors from the elements to the capped
+ ones, so marking them again sets no other bits.
+ */
+void LookupTable::mark_present() {
+    presence_slots = number_of_presence_slots(number_of_elements + number_of_capped);
+    if (LOOKUP_SPARSE || presence.size() != (2*presence_slots + 63)/64)
+        presence.assign((2*presence_slots + 63)/64, 0);
+    for (std::size_t k = 0; k < number_of_keys; ++k) {
+        if (bucket_offsets[k] != bucket_offsets[k+1]) {
+            const std::size_t b = presence_slot(key_at(k));
+            presence[b >> 6] |= static_cast<u_int64_t>(1) << (b & 63);
+        }
+    }
+    
+    for (std::size_t i = 0; i < number_of_elements; ++i) {
+        const std::size_t e = presence_slots + presence_slot(bucket_elements[i].id());
+        presence[e >> 6] |= static_cast<u_int64_t>(1) << (e & 63);
+    }
+    for (std::size_t i = 0; i < number_of_capped; ++i) {
+        const std::size_t b = presence_slot(capped_anchors[i].begin), e = presence_slots + presence_slot(capped_anchors[i].end);
+        presence[b >> 6] |= static_cast<u_int64_t>(1) << (b & 63);
+        presence[e >> 6] |= static_cast<u_int64_t>(1) << (e & 63);
+    }
+    presence_bits = presence.data();
+}
+
+/**
+ Directory of a sparse table: the buckets whose words have leading bits d are
+ [directory[d], directory[d+1])
+ */
+void LookupTable::index_keys() {
+    const std::size_t size = static_cast<std::size_t>(1) << LOOKUP_DIRECTORY_BITS;
+    directory.assign(size+1, 0);
+    for (std::size_t k = 0; k < number_of_keys; ++k)
+        ++directory[1 + (static_cast<u_int64_t>(bucket_keys[k]) >> (2*WORDSIZE - LOOKUP_DIRECTORY_BITS))];
+    for (std::size_t d = 0; d < size; ++d)
+        directory[d+1] += directory[d];
+}
+
+/**
+ Orders every bucket by id, then by index, so that a (key, id) pair is one
+ contiguous run of elements. Both are in the packed bits, it is an integer sort.
+ Blocks of buckets are sorted in parallel.
+ */
+void LookupTable::sort() {
+    const std::size_t blocks = (number_of_keys + LOOKUP_KEY_BLOCK - 1)/LOOKUP_KEY_BLOCK;
+    thread_pool().parallel_for(blocks, [&](const std::size_t b){
+        for (std::size_t k = b*LOOKUP_KEY_BLOCK; k < std::min(number_of_keys, (b+1)*LOOKUP_KEY_BLOCK); ++k) {
+            if (offsets[k+1] - offsets[k] > 1)
+                std::sort(elements.begin()+offsets[k], elements.begin()+offsets[k+1]);
+        }
+    });
+}
+
+/**
+ Drops every (begin, end) anchor with more than +max_occurrences+ elements and
+ records it as capped, the table must be sorted. Returns the number of elements
+ dropped.
+ */
+std::size_t LookupTable::cap(const std::size_t max_occurrences) {
+    std::size_t kept = 0, first = 0;
+    for (std::size_t k = 0; k < number_of_keys; ++k) {
+        const std::size_t last = offsets[k+1];
+        offsets[k] = kept;
+        
+        //runs of one id, moved down over the dropped ones
+        for (std::size_t i = first; i < last; ) {
+            std::size_t j = i+1;
+            while (j < last && elements[j].id() == elements[i].id()) ++j;
+            
+            if (j-i > max_occurrences) {
+                const CappedAnchor anchor = {key_at(k), elements[i].id(), j-i};
+                capped_list.push_back(anchor);
+            } else {
+                std::copy(elements.begin()+i, elements.begin()+j, elements.begin()+kept);
+                kept += j-i;
+            }
+            i = j;
+        }
+        first = last;
+    }
+    offsets[number_of_keys] = kept;
+    
+    const std::size_t dropped = elements.size() - kept;
+    elements.resize(kept);
+    
+    bucket_elements = elements.data();
+    number_of_elements = kept;
+    capped_anchors = capped_list.data();
+    number_of_capped = capped_list.size();
+    mark_present();
+    return dropped;
+}
+
+/**
+ Elements of bucket +begin+ whose id is +end+, the table must be sorted
+ */
+Bucket LookupTable::find(const Hash begin, const Hash end) const {
+    const std::size_t k = slot(begin);
+    if (k >= number_of_keys) return Bucket();
+    
+    const Element *first = bucket_elements + bucket_offsets[k];
+    const Element *last = bucket_elements + bucket_offsets[k+1];
+    if (first == last) return Bucket();
+    
+    //all positions of one id lie between these two
+    const Element lower(end, 0), upper(end, ELEMENT_IDX_MASK);
+    first = std::lower_bound(first, last, lower);
+    return Bucket(first, std::upper_bound(first, last, upper));
+}
+
+static bool capped_less(const CappedAnchor &lhs, const CappedAnchor &rhs) {
+    return lhs.begin < rhs.begin || (lhs.begin == rhs.begin && lhs.end < rhs.end);
+}
+
+/**
+ Number of target positions of the anchor (begin, end) if cap() left it out, 0 otherwise
+ */
+std::size_t LookupTable::capped(const Hash begin, const Hash end) const {
+    if (number_of_capped == 0) return 0;
+    
+    const CappedAnchor anchor = {begin, end, 0};
+    const CappedAnchor *it = std::lower_bound(capped_anchors, capped_anchors + number_of_capped, anchor, capped_less);
+    return it != capped_anchors + number_of_capped && it->begin == begin && it->end == end ? it->count : 0;
+}
+
+/**
+ Offsets of a bucket per possible word of a direct table, the words without
+ elements get empty buckets. An index file keeps this layout when most words are
+ present.
+ */
+void LookupTable::every_word_offsets(std::vector<std::size_t> &o) const {
+    o.assign(LOOKUP_WORDS+1, number_of_elements);
+    std::size_t k = 0;
+    for (std::size_t w = 0; w < LOOKUP_WORDS && k < number_of_keys; ++w) {
+        while (k < number_of_keys && static_cast<std::size_t>(key_at(k)) < w) ++k;
+        o[w] = k < number_of_keys ? bucket_offsets[k] : number_of_elements;
+    }
+}
+
+/**
+ Reads buckets from memory owned by the caller, which must outlive the table's use.
+ Any storage held from a previous build is released, except for the headers of
+ a direct table attached with the words of its buckets: a new generation of
+ them points those words at their buckets. Without +keys+ a direct table has a
+ bucket per possible word.
+ */
+void LookupTable::attach(const std::size_t *o, const Hash *k, const Element *e, const std::size_t keys, const std::size_t size, const CappedAnchor *capped, const std::size_t number_of_capped_anchors, const u_int64_t *present) {
+    std::vector<BucketHeader> kept;
+    kept.swap(headers);
+    release();
+    if (!LOOKUP_SPARSE && k) {
+        headers.swap(kept);
+        next_generation();
+        for (std::size_t i = 0; i < keys; ++i) {
+            headers[k[i]].generation = generation;
+            headers[k[i]].slot = static_cast<u_int32_t>(i);
+        }
+    }
+    
+    bucket_offsets = o;
+    bucket_keys = k;
+    bucket_elements = e;
+    capped_anchors = capped;
+    presence_bits = present;
+    number_of_keys = keys;
+    number_of_elements = size;
+    number_of_capped = number_of_capped_anchors;
+    presence_slots = number_of_presence_slots(size + number_of_capped_anchors);
+    
+    if (LOOKUP_SPARSE)
+        index_keys();
+}
@@ -0,0 +1,171 @@
+//
+//  PackedSequence.cpp
+//
+
+#include "PackedSequence.h"
+#include "Encoding.h"
+
+static const char decoded[] = {'A', 'C', 'G', 'T'};
+
+/**
+ Bases [pos, pos+n) of +s+
+ */
+PackedSequence::PackedSequence(const PackedSequence &s, const std::size_t pos, const std::size_t n) : words(n/32 + 3, 0), ns(n/64 + 3, 0), length(n) {
+    for (std::size_t i = 0; i < n; i += 32) {
+        const std::size_t m = std::min<std::size_t>(32, n-i);
+        const u_int64_t keep = m == 32 ? ~0ULL : (1ULL << m) - 1;
+        words[1 + i/32] = s.bases(static_cast<long>(pos + i)) & (m == 32 ? ~0ULL : (1ULL << 2*m) - 1);
+        ns[1 + i/64] |= (s.ambiguous(static_cast<long>(pos + i)) & keep) << (i & 63);
+    }
+}
+
+void PackedSequence::assign(const Sequence &s) {
+    length = s.size();
+    words.assign(length/32 + 3, 0);
+    ns.assign(length/64 + 3, 0);
+
+    const u_char *p = reinterpret_cast<const u_char *>(s.data());
+    for (std::size_t i = 0; i < length; i += 32) {
+        const std::size_t m = std::min<std::size_t>(32, length-i);
+        u_int64_t word = 0, ambiguous = 0;
+        for (std::size_t j = 0; j < m; ++j) {
+            const u_int64_t code = nucleotide_code[p[i+j]];
+            word |= (code & 0x03) << 2*j;
+            ambiguous |= (code >> 2) << j;
+        }
+        words[1 + i/32] = word;
+        ns[1 + i/64] |= ambiguous << (i & 63);
+    }
+}
+
+void PackedSequence::assign_packed(const char *packed, const std::size_t n) {
+    //the 4 bases of a byte in reverse order
+    static struct Reversed {
+        u_char bytes[256];
+        Reversed() {
+            for (int b = 0; b < 256; ++b)
+                bytes[b] = static_cast<u_char>(((b & 0x03) << 6) | ((b & 0x0C) << 2) | ((b & 0x30) >> 2) | ((b & 0xC0) >> 6));
+        }
+    } const reversed;
+    
+    length = n;
+    words.assign(length/32 + 3, 0);
+    ns.assign(length/64 + 3, 0);
+    
+    const u_char *p = reinterpret_cast<const u_char *>(packed);
+    const std::size_t bytes = (n+3)/4;
+    for (std::size_t i = 0; i < bytes; ++i)
+        words[1 + i/8] |= static_cast<u_int64_t>(reversed.bytes[p[i]]) << 8*(i & 7);
+    
+    //nothing past the last base
+    if (n & 31)
+        words[1 + n/32] &= (static_cast<u_int64_t>(1) << 2*(n & 31)) - 1;
+}
+
+/**
+ Adds +n+ bases after the last one, A until they are put()
+ */
+void PackedSequence::grow(const std::size_t n) {
+    length += n;
+    words.resize(length/32 + 3, 0);
+    ns.resize(length/64 + 3, 0);
+}
+
+/**
+ Sets the 32 bases from +pos+ on, shifted into place across two words, and
+ their ambiguity. Bases past the end must be 0 in both.
+ */
+void PackedSequence::put(const std::size_t pos, const u_int64_t bases, const u_int32_t ambiguous) {
+    const std::size_t w = 1 + pos/32, s = 2*(pos & 31);
+    words[w] |= bases << s;
+    if (s)
+        words[w+1] |= bases >> (64-s);
+    
+    const std::size_t a = 1 + pos/64, t = pos & 63;
+    ns[a] |= static_cast<u_int64_t>(ambiguous) << t;
+    if (t > 32)
+        ns[a+1] |= static_cast<u_int64_t>(ambiguous) >> (64-t);
+}
+
+void PackedSequence::append_packed(const char *packed, const std::size_t n, const u_char *codes) {
+    const std::size_t pos = length;
+    grow(n);
+    
+    const u_char *p = reinterpret_cast<const u_char *>(packed);
+    for (std::size_t i = 0; i < n; i += 32) {
+        const std::size_t m = std::min<std::size_t>(32, n-i);
+        u_int64_t word = 0;
+        for (std::size_t j = 0; j < (m+3)/4; ++j)
+            word |= static_cast<u_int64_t>(codes[p[i/4 + j]]) << 8*j;
+        if (m < 32)
+            word &= (static_cast<u_int64_t>(1) << 2*m) - 1;
+        put(pos+i, word, 0);
+    }
+}
+
+void PackedSequence::append_ambiguous(const std::size_t n) {
+    grow(n);
+    set_ambiguous(length-n, n);
+}
+
+/**
+ Appends the bases of +s+, 32 at a time
+ */
+void PackedSequence::append(const PackedSequence &s) {
+    const std::size_t pos = length;
+    grow(s.length);
+    for (std::size_t i = 0; i < s.length; i += 32)
+        put(pos+i, s.bases(static_cast<long>(i)), s.ambiguous(static_cast<long>(i)));
+}
+
+/**
+ Marks bases [pos, pos+n) ambiguous, stored as A like any other ambiguous letter
+ */
+void PackedSequence::set_ambiguous(const std::size_t pos, const std::size_t n) {
+    for (std::size_t i = pos; i < pos+n; ) {
+        if (!(i & 63) && i+64 <= pos+n) {
+            ns[1 + i/64] = ~static_cast<u_int64_t>(0);
+            words[1 + i/32] = words[2 + i/32] = 0;
+            i += 64;
+        } else {
+            ns[1 + i/64] |= static_cast<u_int64_t>(1) << (i & 63);
+            words[1 + i/32] &= ~(static_cast<u_int64_t>(3) << 2*(i & 31));
+            ++i;
+        }
+    }
+}
+
+void PackedSequence::clear() {
+    std::vector<u_int64_t>().swap(words);
+    std::vector<u_int64_t>().swap(ns);
+    length = 0;
+}
+
+void PackedSequence::swap(PackedSequence &other) {
+    words.swap(other.words);
+    ns.swap(other.ns);
+    std::swap(length, other.length);
+}
+
+char PackedSequence::operator[](const std::size_t i) const {
+    if ((ns[1 + i/64] >> (i & 63)) & 1) return 'N';
+    return decoded[(words[1 + i/32] >> 2*(i & 31)) & 0x03];
+}
+
+Sequence PackedSequence::substr(const std::size_t pos, const std::size_t n) const {
+    Sequence s(n, 'N');
+    for (std::size_t i = 0; i < n; ++i)
+        s[i] = (*this)[pos+i];
+    return s;
+}
+
+Sequence PackedSequence::reverse_complement(const std::size_t pos, const std::size_t n) const {
+    static const char complement[] = {'T', 'G', 'C', 'A'};
+    Sequence s(n, 'N');
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::size_t j = pos+n-1-i;
+        if (!((ns[1 + j/64] >> (j & 63)) & 1))
+            s[i] = complement[(words[1 + j/32] >> 2*(j & 31)) & 0x03];
+    }
+    return s;
+}
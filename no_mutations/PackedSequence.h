@@ -0,0 +1,157 @@
+//
+//  PackedSequence.h
+//
+
+#ifndef PackedSequence_hpp
+#define PackedSequence_hpp
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <sys/types.h>
+
+#include "Types.h"
+
+/**
+ Sequence held with 2 bits per base (the BA_ENCODED_* codes) and one bit per
+ base marking letters outside ACGT/acgt, which are stored as A. Case is not
+ kept and every ambiguous letter reads back as N.
+
+ Base i is in bits 2*(i%32) of bases word i/32 and its ambiguity bit is bit
+ i%64 of ambiguity word i/64. A word of padding on either side allows reading
+ the 32 bases from any position in [-32, size].
+ */
+class PackedSequence {
+public:
+    PackedSequence() : length(0) {}
+    explicit PackedSequence(const Sequence &s) : length(0) { assign(s); }
+    PackedSequence(const PackedSequence &s, const std::size_t pos, const std::size_t n);
+
+    void assign(const Sequence &s);
+    
+    /**
+     +n+ bases packed 4 per byte, the first in the highest bits, as index files store them
+     */
+    void assign_packed(const char *packed, const std::size_t n);
+    
+    /**
+     Appends +n+ bases packed 4 per byte, the first in the highest bits, read
+     through +codes+: the BA_ENCODED_* codes of the 4 bases of every byte, the
+     first in the lowest bits
+     */
+    void append_packed(const char *packed, const std::size_t n, const u_char *codes);
+    void append_ambiguous(const std::size_t n);
+    void append(const PackedSequence &s);
+    void set_ambiguous(const std::size_t pos, const std::size_t n);
+    void clear();
+    void swap(PackedSequence &other);
+
+    std::size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    /**
+     Bases pos, pos+1, ..., pos+31, base pos+j in bits 2j and 2j+1
+     */
+    u_int64_t bases(const long pos) const {
+        const std::size_t g = static_cast<std::size_t>(pos + 32);
+        const std::size_t w = g >> 5, s = 2*(g & 31);
+        return s ? (words[w] >> s) | (words[w+1] << (64-s)) : words[w];
+    }
+
+    /**
+     Ambiguity of bases pos, pos+1, ..., pos+31, base pos+j in bit j
+     */
+    u_int32_t ambiguous(const long pos) const {
+        const std::size_t g = static_cast<std::size_t>(pos + 64);
+        const std::size_t w = g >> 6, s = g & 63;
+        return static_cast<u_int32_t>(s ? (ns[w] >> s) | (ns[w+1] << (64-s)) : ns[w]);
+    }
+
+    char operator[](const std::size_t i) const;
+    Sequence substr(const std::size_t pos, const std::size_t n) const;
+
+    /**
+     Reverse complement of substr(pos, n)
+     */
+    Sequence reverse_complement(const std::size_t pos, const std::size_t n) const;
+
+private:
+    void grow(const std::size_t n);
+    void put(const std::size_t pos, const u_int64_t bases, const u_int32_t ambiguous);
+    
+    std::vector<u_int64_t> words, ns;
+    std::size_t length;
+};
+
+#pragma mark - Word at a time comparison
+//the 32 bases of +x+ in reverse order
+inline u_int64_t reverse_bases(u_int64_t x) {
+    x = __builtin_bswap64(x);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+}
+
+//the 32 bits of +x+ in reverse order
+inline u_int32_t reverse_bits(u_int32_t x) {
+    x = __builtin_bswap32(x);
+    x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+    x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+    return ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+}
+
+//bit j of +x+ to bit 2j
+inline u_int64_t spread_bits(const u_int32_t x) {
+    u_int64_t v = x;
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    return (v | (v << 1)) & 0x5555555555555555ULL;
+}
+
+/**
+ Bases k, k+1, ..., k+31 of +s+ read from +pos+, forwards s[pos+k], ... or
+ BACKWARDS s[pos-1-k], ..., base k+j in bits 2j. COMPLEMENT gives their
+ complements, A(0)<->T(3) and C(1)<->G(2).
+ */
+template <bool BACKWARDS, bool COMPLEMENT>
+inline u_int64_t read_bases(const PackedSequence &s, const std::size_t pos, const std::size_t k) {
+    const u_int64_t x = BACKWARDS ? reverse_bases(s.bases(static_cast<long>(pos) - static_cast<long>(k) - 32)) : s.bases(static_cast<long>(pos + k));
+    return COMPLEMENT ? ~x : x;
+}
+
+template <bool BACKWARDS>
+inline u_int32_t read_ambiguous(const PackedSequence &s, const std::size_t pos, const std::size_t k) {
+    return BACKWARDS ? reverse_bits(s.ambiguous(static_cast<long>(pos) - static_cast<long>(k) - 32)) : s.ambiguous(static_cast<long>(pos + k));
+}
+
+/**
+ Compares bases k, ..., k+31 of +a+ and +b+ read as by read_bases(), bit 2j of
+ +mismatches+ is set when base k+j differs and of +ambiguous+ when it is
+ ambiguous in either sequence
+ */
+template <bool A_BACKWARDS, bool B_BACKWARDS, bool A_COMPLEMENT>
+inline void compare_bases(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t k, u_int64_t &mismatches, u_int64_t &ambiguous) {
+    const u_int64_t d = read_bases<A_BACKWARDS, A_COMPLEMENT>(a, pa, k) ^ read_bases<B_BACKWARDS, false>(b, pb, k);
+    mismatches = (d | (d >> 1)) & 0x5555555555555555ULL;
+
+    const u_int32_t n = read_ambiguous<A_BACKWARDS>(a, pa, k) | read_ambiguous<B_BACKWARDS>(b, pb, k);
+    ambiguous = n ? spread_bits(n) : 0;
+}
+
+/**
+ Number of bases, at most +n+, that +a+ and +b+ read as by read_bases() have in
+ common before the first mismatch or ambiguous base
+ */
+template <bool A_BACKWARDS, bool B_BACKWARDS, bool A_COMPLEMENT>
+inline std::size_t common_length(const PackedSequence &a, const std::size_t pa, const PackedSequence &b, const std::size_t pb, const std::size_t n) {
+    for (std::size_t k = 0; k < n; k += 32) {
+        u_int64_t mismatches, ambiguous;
+        compare_bases<A_BACKWARDS, B_BACKWARDS, A_COMPLEMENT>(a, pa, b, pb, k, mismatches, ambiguous);
+        if (const u_int64_t events = mismatches | ambiguous)
+            return std::min(n, k + __builtin_ctzll(events)/2);
+    }
+    return n;
+}
+
+#endif /* PackedSequence_hpp */
@@ -0,0 +1,65 @@
+//
+//  Prefetcher.h
+//
+
+#ifndef Prefetcher_hpp
+#define Prefetcher_hpp
+
+#include <cstddef>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Types.h"
+#include "IO.h"
+
+/**
+ Reads fasta files on a background thread ahead of when they are needed, so
+ that reading, newline stripping and packing overlap the search of the current
+ pair. Every request is identified by a ticket chosen by the caller and is
+ collected exactly once with take().
+ */
+class Prefetcher {
+public:
+    Prefetcher();
+    ~Prefetcher();
+    
+    /**
+     Reads +file+ under +ticket+, with its runs of lowercase bases if +soft_masked+
+     */
+    void request(const std::size_t ticket, const File &file, const bool soft_masked=false);
+    
+    /**
+     Records of +file+ packed in +sequence+, read under +ticket+ in the background
+     if it was requested and read now otherwise. +waited+ is set to the seconds
+     spent waiting for it. The runs of lowercase bases go in +soft_masked+ when
+     given, which the request must have asked for.
+     */
+    void take(const std::size_t ticket, const File &file, RecordTable &records, PackedSequence &sequence, double &waited, std::vector<MaskBlock> *soft_masked=NULL);
+    
+private:
+    Prefetcher(const Prefetcher &);
+    Prefetcher & operator=(const Prefetcher &);
+    
+    void work();
+    
+    struct Entry {
+        enum State { QUEUED, LOADING, READY } state;
+        File file;
+        bool masked;        //soft_masked is collected
+        RecordTable records;
+        PackedSequence data;
+        std::vector<MaskBlock> soft_masked;
+    };
+    
+    std::map<std::size_t, Entry> entries;
+    std::deque<std::size_t> queue;
+    std::mutex mutex;
+    std::condition_variable requested;
+    bool stopping;
+    std::thread loader;
+};
+
+#endif /* Prefetcher_hpp */
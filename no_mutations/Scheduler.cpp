@@ -0,0 +1,56 @@
+//
+//  Scheduler.cpp
+//
+
+#include "Scheduler.h"
+
+#include <algorithm>
+
+#pragma mark - Memory budget
+MemoryBudget::MemoryBudget(const std::size_t bytes) : limit(bytes), used(0), running(0) {}
+
+void MemoryBudget::acquire(const std::size_t bytes, const std::size_t pairs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&]{ return running == 0 || used + bytes <= limit; });
+    used += bytes;
+    running += pairs;
+}
+
+void MemoryBudget::give_back(const std::size_t bytes, const std::size_t pairs) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= bytes;
+        running -= pairs;
+    }
+    released.notify_all();
+}
+
+#pragma mark - Pairs
+std::vector<Pair> schedule_pairs(const std::vector<std::size_t> &target_sizes, const std::vector<std::size_t> &query_sizes) {
+    std::vector<std::size_t> targets(target_sizes.size()), queries(query_sizes.size());
+    for (std::size_t i = 0; i < targets.size(); ++i) targets[i] = i;
+    for (std::size_t j = 0; j < queries.size(); ++j) queries[j] = j;
+    
+    std::stable_sort(targets.begin(), targets.end(), [&](const std::size_t a, const std::size_t b){ return target_sizes[a] > target_sizes[b]; });
+    std::stable_sort(queries.begin(), queries.end(), [&](const std::size_t a, const std::size_t b){ return query_sizes[a] > query_sizes[b]; });
+    
+    std::vector<Pair> pairs;
+    pairs.reserve(targets.size()*queries.size());
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        for (std::size_t j = 0; j < queries.size(); ++j) {
+            const Pair pair = {targets[i], queries[j]};
+            pairs.push_back(pair);
+        }
+    }
+    return pairs;
+}
+
+#pragma mark - Output
+SharedOutput::SharedOutput(std::ostream &o) : out(o) {}
+
+void SharedOutput::write(const std::string &text) {
+    if (text.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    out << text;
+    out.flush();
+}
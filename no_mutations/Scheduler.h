@@ -0,0 +1,76 @@
+//
+//  Scheduler.h
+//
+
+#ifndef Scheduler_hpp
+#define Scheduler_hpp
+
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ Bytes that the pairs in flight and the targets they share may hold at once.
+ A reservation blocks until it fits, or until no pair is running so that a
+ pair larger than the whole budget still runs.
+ */
+class MemoryBudget {
+public:
+    explicit MemoryBudget(const std::size_t bytes);
+    
+    //memory of one running pair
+    void reserve(const std::size_t bytes) { acquire(bytes, 1); }
+    void release(const std::size_t bytes) { give_back(bytes, 1); }
+    
+    //memory shared by several pairs, e.g. a target and its lookup table
+    void reserve_shared(const std::size_t bytes) { acquire(bytes, 0); }
+    void release_shared(const std::size_t bytes) { give_back(bytes, 0); }
+    
+private:
+    MemoryBudget(const MemoryBudget &);
+    MemoryBudget & operator=(const MemoryBudget &);
+    
+    void acquire(const std::size_t bytes, const std::size_t pairs);
+    void give_back(const std::size_t bytes, const std::size_t pairs);
+    
+    const std::size_t limit;
+    std::size_t used, running;
+    std::mutex mutex;
+    std::condition_variable released;
+};
+
+/**
+ One comparison of a target file with a query file
+ */
+struct Pair {
+    std::size_t target, query;
+};
+
+/**
+ Every pair of +targets+ x +queries+, largest target first and within a
+ target largest query first, so that the longest pairs do not start last
+ */
+std::vector<Pair> schedule_pairs(const std::vector<std::size_t> &target_sizes, const std::vector<std::size_t> &query_sizes);
+
+/**
+ Writes the text of a pair to +out+ as soon as the pair is done, each text
+ whole. Nothing is held back, so texts come in the order the pairs finish.
+ */
+class SharedOutput {
+public:
+    explicit SharedOutput(std::ostream &out);
+    
+    void write(const std::string &text);
+    
+private:
+    SharedOutput(const SharedOutput &);
+    SharedOutput & operator=(const SharedOutput &);
+    
+    std::ostream &out;
+    std::mutex mutex;
+};
+
+#endif /* Scheduler_hpp */
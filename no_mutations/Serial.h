@@ -10,34 +10,113 @@
 #define __Limes__Serial__
 
 #include <fstream>
+#include <sstream>
+#include <atomic>
 #include <assert.h>
 #include <stdarg.h>
 #include <cstdarg>
 #include <bitset>
+#include <functional>
+#include <unordered_map>
 
 #include "Types.h"
 #include "IO.h"
 #include "Util.h"
+#include "Encoding.h"
+#include "PackedSequence.h"
+#include "LookupTable.h"
+#include "IndexFile.h"
+#include "ThreadPool.h"
+#include "Scheduler.h"
+#include "Prefetcher.h"
 #include "Timing.hpp"
 
 typedef std::pair<std::string::size_type, int> Lime;
 typedef std::vector<Lime> Limes;
 
-extern Limes limeObjs_target;
-extern Limes limeObjs_query;
+//candidates verified at a time. Each worker generates and verifies the candidates of its own query
+//range, so phase I holds at most this plus those of one anchor per worker: the memory bound depends
+//on CANDIDATE_BATCH only, not on the number of candidates of a chromosome pair
+#define CANDIDATE_BATCH 65536
+
+//query anchor ranges of a chromosome pair searched in parallel, not tied to --threads so that output does not depend on it
+#define QUERY_RANGES 256
+
+//bases of unassembled scaffolds packed into one target and indexed at once
+#ifndef SCAFFOLD_BLOCK
+#define SCAFFOLD_BLOCK (64*1024*1024)
+#endif
+
+/**
+ Limes found by one worker, merged in query order once a pair is done
+ */
+class LimeBuffer {
+public:
+    LimeBuffer() : candidates(0), skipped_anchors(0), skipped_candidates(0), anchors(0), dust_anchors(0), dust_candidates(0), prefilter_hits(0), prefilter_skips(0) {}
+    
+    Limes target, query;
+    std::size_t candidates;     //seen by phase II
+    std::size_t skipped_anchors, skipped_candidates;    //query anchors and candidates left out by --max-occurrences
+    std::size_t anchors, dust_anchors;    //valid query anchors and those left out by --dust
+    std::size_t dust_candidates;          //exact matches of the anchors left out by --dust, a lower bound of the candidates avoided
+    std::size_t prefilter_hits, prefilter_skips;        //table lookups made and turned away by the presence bitmaps
+};
+
+/**
+ How far phase II has extended along the diagonals, carried from one candidate
+ batch of a query range to the next. Only stretches reaching past the anchors
+ of the batch they were found in are kept.
+ */
+class DiagonalCover {
+public:
+    DiagonalCover() : last(0) {}
+    
+    //drops the stretches that end before the anchors of +candidates+
+    void start_batch(const Candidates &candidates) {
+        std::size_t first = candidates.front().idx_1;
+        last = first;
+        for (const Candidate &c : candidates) {
+            first = std::min<std::size_t>(first, c.idx_1);
+            last = std::max<std::size_t>(last, c.idx_1);
+        }
+        for (std::unordered_map<long, std::size_t>::iterator it = ends.begin(); it != ends.end(); )
+            it = it->second <= first ? ends.erase(it) : std::next(it);
+    }
+    
+    //query position up to which +diagonal+ is covered
+    std::size_t end(const long diagonal) const {
+        if (ends.empty()) return 0;
+        const std::unordered_map<long, std::size_t>::const_iterator it = ends.find(diagonal);
+        return it == ends.end() ? 0 : it->second;
+    }
+    
+    void set(const long diagonal, const std::size_t end) {
+        if (end > last)
+            ends[diagonal] = end;
+        else if (!ends.empty())
+            ends.erase(diagonal);
+    }
+    
+private:
+    std::size_t last;       //largest query position in the current batch
+    std::unordered_map<long, std::size_t> ends;
+};
+
 extern LookupTable vec2D;
 extern scottgs::Timing timer;
 
-void remove_invalid_lime_candidates(Candidates &, const Sequence &, const Sequence &);
-void remove_invalid_lime_candidates_reverse(Candidates &, const Query &, const Target &);
-void find_lime_candidates(Chromosome &query_chr, Candidates &candidates);
+void remove_invalid_lime_candidates(Candidates &, const PackedSequence &, const PackedSequence &, DiagonalCover &, LimeBuffer &);
+void remove_invalid_lime_candidates_reverse(Candidates &, const PackedSequence &, const PackedSequence &, DiagonalCover &, LimeBuffer &);
+void stream_lime_candidates(const LookupTable &table, const Chromosome &query_chr, const std::size_t first, const std::size_t last, LimeBuffer &limes, const std::function<void(Candidates &)> &verify);
 
-void find_limes_in_forward_direction(QueryChr &, const Query &, const Target &, Candidates &);
-void find_limes_in_reverse_direction(QueryChr &, const Query &, const Target &, Candidates &candidates);
-void find_limes(const Target &, const Query &, const QueryChr&);
+void find_limes(const LookupTable &, const PackedSequence &, const PackedSequence &, LimeBuffer &);
+void find_limes(const LookupTable &, const PackedSequence &, const PackedSequence &, const RecordTable &, LimeBuffer &);
 
 void run(const Files &, const Files &, const Output &, const Progress &);
 void run(const Sequence &, const Files &g, const Output &, const Progress &);
 void run(const File &, const File &, const Output &, const Progress &);
+void build_index(const Files &, const Path &);
+void bench_encode(const File &, const int repeats);
+void bench_lookup_table(const File &, const int repeats);
 
 #endif /* defined(__Limes__Serial__) */
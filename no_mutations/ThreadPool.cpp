@@ -0,0 +1,129 @@
+//
+//  ThreadPool.cpp
+//
+
+#include "ThreadPool.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/**
+ +threads+ counts the calling thread, a pool of 1 runs everything inline
+ */
+ThreadPool::ThreadPool(const unsigned threads) : stopping(false), active(std::max(1u, threads)) {
+    for (unsigned i = 1; i < threads; ++i)
+        workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (std::vector<std::thread>::size_type i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]{ return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+            
+            job.swap(jobs.front().run);
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+namespace {
+    /**
+     Shared between the caller of parallel_for and the helpers it posts, a helper
+     that only starts after the loop is finished finds nothing left to do
+     */
+    struct Loop {
+        Loop(const std::size_t size, const std::function<void(std::size_t)> &t) : n(size), next(0), done(0), task(t) {}
+        
+        void run() {
+            std::size_t k, finished = 0;
+            while ((k = next++) < n) {
+                task(k);
+                ++finished;
+            }
+            if (finished && (done += finished) == n) {
+                std::lock_guard<std::mutex> lock(mutex);
+                completed.notify_all();
+            }
+        }
+        
+        const std::size_t n;
+        std::atomic<std::size_t> next, done;
+        std::function<void(std::size_t)> task;
+        std::mutex mutex;
+        std::condition_variable completed;
+    };
+}
+
+void ThreadPool::parallel_for(const std::size_t n, const std::function<void(std::size_t)> &task, const bool blocking) {
+    if (n == 0) return;
+    if (size() == 1 || n == 1) {
+        for (std::size_t k = 0; k < n; ++k)
+            task(k);
+        return;
+    }
+    
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>(n, task);
+    const std::size_t helpers = std::min<std::size_t>(n-1, size()-1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::size_t i = 0; i < helpers; ++i) {
+            const Job job = {[loop]{ loop->run(); }, blocking};
+            jobs.push_back(job);
+        }
+    }
+    available.notify_all();
+    
+    loop->run();
+    
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->completed.wait(lock, [&loop]{ return loop->done == loop->n; });
+}
+
+void ThreadPool::help_until(const std::function<bool()> &ready) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        bool done = false;
+        std::deque<Job>::iterator it;
+        available.wait(lock, [&]{
+            if ((done = ready())) return true;
+            it = std::find_if(jobs.begin(), jobs.end(), [](const Job &job){ return !job.blocking; });
+            return it != jobs.end();
+        });
+        if (done) return;
+        
+        std::function<void()> job;
+        job.swap(it->run);
+        jobs.erase(it);
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+void ThreadPool::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    available.notify_all();
+}
+
+ThreadPool & thread_pool() {
+    static ThreadPool pool(options.threads);
+    return pool;
+}
@@ -0,0 +1,74 @@
+//
+//  ThreadPool.h
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <cstddef>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/**
+ Fixed set of worker threads
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(const unsigned threads);
+    ~ThreadPool();
+
+    unsigned size() const { return std::min(static_cast<unsigned>(workers.size()) + 1, active); }
+    
+    /**
+     Runs parallel_for on at most +threads+ threads, the caller included, to
+     compare thread counts within one run. Not to be changed while a loop runs.
+     */
+    void limit(const unsigned threads) { active = std::max(1u, threads); }
+
+    /**
+     Calls task(k) for every k in [0, n) and returns once all of them are done.
+     The calling thread takes part, so parallel_for can be nested in a task.
+     Tasks that may block in help_until() themselves, such as long-lived
+     workers, are marked +blocking+: only idle threads start their helpers.
+     */
+    void parallel_for(const std::size_t n, const std::function<void(std::size_t)> &task, const bool blocking = false);
+
+    /**
+     Returns once ready() holds, running queued jobs in the meantime, so that a
+     thread of the pool waiting for work that is itself done with parallel_for
+     does not keep its helpers from starting. ready() is called with the pool
+     locked and must not use the pool; whoever makes it true calls wake().
+     */
+    void help_until(const std::function<bool()> &ready);
+    void wake();
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool & operator=(const ThreadPool &);
+
+    void work();
+
+    struct Job {
+        std::function<void()> run;
+        bool blocking;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping;
+    unsigned active;    //threads used by parallel_for, at most workers.size() + 1
+};
+
+/**
+ Pool shared by the whole process, sized by --threads
+ */
+ThreadPool & thread_pool();
+
+#endif /* ThreadPool_hpp */
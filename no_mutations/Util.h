@@ -17,14 +17,31 @@
 
 #include "Types.h"
 
+/**
+ Tunables given on the command line as --name=value, anywhere among the arguments
+ */
+struct Options {
+    Options();
+    
+    unsigned threads;   //worker threads shared by the chromosome pairs in flight, including the main thread
+    std::size_t memory; //bytes of targets and queries held at once, given in MB
+    std::size_t max_occurrences;    //target anchors occurring more often are left out of the lookup table, 0 keeps all
+    bool exclude_soft_masked;       //leave lowercase words out of the lookup table
+    double dust;                    //DUST score above which query anchors and target words are left out, 0 keeps all
+    bool whole_genome;              //one lookup table over every target file, each query searched once per shard of it
+    bool sliced_build;              //build direct lookup tables from one target slice per thread
+};
+extern Options options;
+
+bool parse_options(int &argc, const char *argv[]);
 
 bool file_exists(const Path &);
 bool directory_file_exists(const Path &);
+bool has_extension(const File &, const Extension &);
+std::size_t file_size(const File &);
     
 bool isAssembled(Files &g);
 bool isAssembled(const File &file);
 
-void reverse_complement(Sequence &);
-
 
 #endif /* Util_hpp */
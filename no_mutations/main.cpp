@@ -10,8 +10,69 @@
 
 
 int main(int argc, const char * argv[]) {
+    if (!parse_options(argc, argv)) return EXIT_FAILURE;
+    
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "index") {
+        if (argc < 5) {
+            std::cerr << "usage: ./Limes index <genome dir> <file_ext> [fa]> <index dir>" << std::endl;
+            return EXIT_FAILURE;
+        }
+        const Files g = retrieve_directory_content(argv[2], argv[3]);
+        if (g.empty()) return EXIT_FAILURE;
+        
+        build_index(g, argv[4]);
+        return EXIT_SUCCESS;
+    } else if (mode == "search") {
+        if (argc < 7) {
+            std::cerr << "usage: ./Limes search <index dir> <genome 2 dir> <file_ext> [fa]> <limes file> <progress file>" << std::endl;
+            return EXIT_FAILURE;
+        }
+        const Files g1 = retrieve_directory_content(argv[2], INDEX_FILE_EXTENSION);
+        const Files g2 = retrieve_directory_content(argv[3], argv[4]);
+        if (g1.empty() || g2.empty()) return EXIT_FAILURE;
+        
+        run(g1, g2, argv[5], argv[6]);
+        return EXIT_SUCCESS;
+    } else if (mode == "scaffolds") {
+        if (argc < 6) {
+            std::cerr << "usage: ./Limes scaffolds <query file> <scaffolds file> <limes file> <progress file>" << std::endl;
+            return EXIT_FAILURE;
+        }
+        run(File(argv[2]), File(argv[3]), argv[4], argv[5]);
+        return EXIT_SUCCESS;
+    } else if (mode == "bench-encode") {
+        if (argc < 3) {
+            std::cerr << "usage: ./Limes bench-encode <genome file> [repeats]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        bench_encode(argv[2], argc > 3 ? std::max(1, atoi(argv[3])) : 5);
+        return EXIT_SUCCESS;
+    } else if (mode == "bench-lookup") {
+        if (argc < 3) {
+            std::cerr << "usage: ./Limes bench-lookup <genome file> [repeats] [--threads=<n>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        bench_lookup_table(argv[2], argc > 3 ? std::max(1, atoi(argv[3])) : 3);
+        return EXIT_SUCCESS;
+    }
+    
     if (argc < 6)  {
         std::cerr << "usage: ./Limes <genome 1 dir> <genome 2 dir> <file_ext> [fa]> <limes file> <progress file>" << std::endl;
+        std::cerr << "       ./Limes index <genome dir> <file_ext> [fa]> <index dir>" << std::endl;
+        std::cerr << "       ./Limes search <index dir> <genome 2 dir> <file_ext> [fa]> <limes file> <progress file>" << std::endl;
+        std::cerr << "       ./Limes scaffolds <query file> <scaffolds file> <limes file> <progress file>" << std::endl;
+        std::cerr << "       ./Limes bench-encode <genome file> [repeats]" << std::endl;
+        std::cerr << "       ./Limes bench-lookup <genome file> [repeats] [--threads=<n>]" << std::endl;
+        std::cerr << "options: --threads=<n>            worker threads, shared by the chromosome pairs searched at once (default: all cores)" << std::endl;
+        std::cerr << "         --memory=<MB>            memory for the targets and queries loaded at once (default: physical memory)" << std::endl;
+        std::cerr << "         --max-occurrences=<n>    leave target anchors seen more than n times out of the lookup table (default: keep all)" << std::endl;
+        std::cerr << "         --exclude-soft-masked    leave lowercase (soft-masked) target words out of the lookup table, bases are otherwise compared ignoring case" << std::endl;
+        std::cerr << "         --dust=<score>           leave low complexity query anchors and target words out, 20 is a common score (default: keep all)" << std::endl;
+        std::cerr << "         --whole-genome           index every genome 1 file as one target, each genome 2 file is read once (per shard)" << std::endl;
+        std::cerr << "         --sliced-build           build large lookup tables from one target slice per thread, each with a counter per possible word (default: one slice)" << std::endl;
+        std::cerr << "an index keeps the --max-occurrences, --exclude-soft-masked and --dust it was built with, search must be given the same" << std::endl;
+        std::cerr << "search reads the fasta file of every index again and rejects the index if its records or bases have changed" << std::endl;
         return EXIT_FAILURE;
     } else {
         const std::string dir1 = argv[1];